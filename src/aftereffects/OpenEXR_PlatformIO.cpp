@@ -26,6 +26,11 @@
 
 #include "ProEXR_UTF.h"
 
+#include <IlmThreadMutex.h>
+
+#include <list>
+#include <algorithm>
+
 #include <time.h>
 #include <assert.h>
 
@@ -35,29 +40,61 @@ using namespace Iex;
 
 extern AEGP_PluginID	S_mem_id;
 
-static AEGP_MemHandle	file_cacheH = NULL;
-static PathString		file_cache_path;
-static DateTime			file_cache_date_time;
-static Int64			file_cache_size = 0;
-static time_t			file_cache_last_access;
+
+// Files that have been read into memory, most recently used first.  An entry
+// is pinned while a stream has it adopted, and only unpinned ones get freed,
+// either to make room under the budget or by DeleteFileCache() when they've
+// been sitting around too long.  A file bigger than the whole budget still
+// gets cached, it just pushes everything else out.
+struct FileCacheEntry
+{
+	AEGP_MemHandle	memH;
+	PathString		path;
+	DateTime		date_time;
+	Int64			size;
+	time_t			last_access;
+	int				pins;
+};
+
+typedef std::list<FileCacheEntry *> FileCacheList;
+
+static FileCacheList	file_cache;
+static Int64			file_cache_bytes = 0;
+static Int64			file_cache_budget = ((Int64)1024 * 1024 * 1024);
+static IlmThread::Mutex	file_cache_mutex;
 
 
 static bool
-MatchCacheDateTime(DateTime date_time)
+MatchCacheDateTime(const DateTime &d1, const DateTime &d2)
 {
 #ifdef __APPLE__
-	return (date_time.fraction == file_cache_date_time.fraction &&
-			date_time.lowSeconds == file_cache_date_time.lowSeconds &&
-			date_time.highSeconds == file_cache_date_time.highSeconds);
+	return (d1.fraction == d2.fraction &&
+			d1.lowSeconds == d2.lowSeconds &&
+			d1.highSeconds == d2.highSeconds);
 #else
-	return (date_time.dwHighDateTime == file_cache_date_time.dwHighDateTime &&
-			date_time.dwLowDateTime == file_cache_date_time.dwLowDateTime);
+	return (d1.dwHighDateTime == d2.dwHighDateTime &&
+			d1.dwLowDateTime == d2.dwLowDateTime);
 #endif
 }
 
 
+// these all expect file_cache_mutex to be locked
+
+static FileCacheEntry *
+FindFileCache(const PathString &path, const DateTime &date_time)
+{
+	for(FileCacheList::iterator i = file_cache.begin(); i != file_cache.end(); ++i)
+	{
+		if(MatchCacheDateTime((*i)->date_time, date_time) && (*i)->path == path)
+			return *i;
+	}
+	
+	return NULL;
+}
+
+
 static void *
-LockFileCache(const SPBasicSuite *pica_basicP)
+PinFileCache(const SPBasicSuite *pica_basicP, FileCacheEntry *entry)
 {
 	A_Err err = A_Err_NONE;
 	
@@ -68,11 +105,16 @@ LockFileCache(const SPBasicSuite *pica_basicP)
 
 	void *cache = NULL;
 	
-	if(file_cacheH)
+	err = suites.MemorySuite()->AEGP_LockMemHandle(entry->memH, (void**)&cache);
+	
+	if(cache)
 	{
-		err = suites.MemorySuite()->AEGP_LockMemHandle(file_cacheH, (void**)&cache);
+		entry->pins++;
+		entry->last_access = time(NULL);
 		
-		file_cache_last_access = time(NULL);
+		// most recently used goes to the front
+		file_cache.remove(entry);
+		file_cache.push_front(entry);
 	}
 	
 	return cache;
@@ -80,7 +122,7 @@ LockFileCache(const SPBasicSuite *pica_basicP)
 
 
 static void
-UnlockFileCache(const SPBasicSuite *pica_basicP)
+UnpinFileCache(const SPBasicSuite *pica_basicP, FileCacheEntry *entry)
 {
 	A_Err err = A_Err_NONE;
 	
@@ -89,8 +131,45 @@ UnlockFileCache(const SPBasicSuite *pica_basicP)
 	
 	AEGP_SuiteHandler suites(pica_basicP);
 
-	if(file_cacheH)
-		err = suites.MemorySuite()->AEGP_UnlockMemHandle(file_cacheH);
+	assert(entry->pins > 0);
+	
+	err = suites.MemorySuite()->AEGP_UnlockMemHandle(entry->memH);
+	
+	entry->pins--;
+	entry->last_access = time(NULL);
+}
+
+
+static void
+FreeFileCache(const SPBasicSuite *pica_basicP, FileCacheList::iterator entry)
+{
+	assert((*entry)->pins == 0);
+	
+	AEGP_SuiteHandler suites(pica_basicP);
+
+	A_Err err = suites.MemorySuite()->AEGP_FreeMemHandle((*entry)->memH);
+	
+	file_cache_bytes -= (*entry)->size;
+	
+	delete *entry;
+	
+	file_cache.erase(entry);
+}
+
+
+static void
+MakeFileCacheRoom(const SPBasicSuite *pica_basicP, Int64 size)
+{
+	// free least recently used first
+	FileCacheList::iterator i = file_cache.end();
+	
+	while(file_cache_bytes + size > file_cache_budget && i != file_cache.begin())
+	{
+		--i;
+		
+		if((*i)->pins == 0)
+			FreeFileCache(pica_basicP, i++);
+	}
 }
 
 
@@ -100,38 +179,33 @@ DeleteFileCache(const SPBasicSuite *pica_basicP, int timeout)
 	if(pica_basicP == NULL)
 		throw LogicExc("pica_basicP is NULL");
 	
-	if(file_cacheH && (timeout == 0 || (difftime(time(NULL), file_cache_last_access) > timeout)) )
+	IlmThread::Lock lock(file_cache_mutex);
+	
+	const time_t now = time(NULL);
+	
+	FileCacheList::iterator i = file_cache.begin();
+	
+	while(i != file_cache.end())
 	{
-		AEGP_SuiteHandler suites(pica_basicP);
-
-		A_Err err = suites.MemorySuite()->AEGP_FreeMemHandle(file_cacheH);
-		
-		file_cacheH = NULL;
-		file_cache_path = "";
-		file_cache_size = 0;
+		if((*i)->pins == 0 && (timeout == 0 || difftime(now, (*i)->last_access) > timeout))
+			FreeFileCache(pica_basicP, i++);
+		else
+			++i;
 	}
 }
 
 
-static void *
-NewFileCache(const SPBasicSuite *pica_basicP, AEGP_MemSize size)
+void
+SetFileCacheBudget(const SPBasicSuite *pica_basicP, Int64 bytes)
 {
-	A_Err err = A_Err_NONE;
-	
 	if(pica_basicP == NULL)
 		throw LogicExc("pica_basicP is NULL");
 	
-	AEGP_SuiteHandler suites(pica_basicP);
-
-	DeleteFileCache(pica_basicP);
+	IlmThread::Lock lock(file_cache_mutex);
 	
-	err = suites.MemorySuite()->AEGP_NewMemHandle(S_mem_id, "File Cache", size,
-													AEGP_MemFlag_CLEAR, &file_cacheH);
-													
-	if(file_cacheH)
-		file_cache_size = size;
-																																					
-	return LockFileCache(pica_basicP);
+	file_cache_budget = bytes;
+	
+	MakeFileCacheRoom(pica_basicP, 0);
 }
 
 #pragma mark-
@@ -141,6 +215,7 @@ IStreamPlatform::IStreamPlatform(const char fileName[], const SPBasicSuite *pica
 	IStream(fileName),
 	_pica_basicP(pica_basicP),
 	_vfile(NULL),
+	_cache(NULL),
 	_path(fileName)
 {
 	open_file(fileName);
@@ -153,6 +228,7 @@ IStreamPlatform::IStreamPlatform(const uint16_t fileName[], const SPBasicSuite *
 	IStream("Unicode Path"),
 	_pica_basicP(pica_basicP),
 	_vfile(NULL),
+	_cache(NULL),
 	_path(fileName)
 {
 	open_file(fileName);
@@ -246,29 +322,108 @@ IStreamPlatform::memoryMap()
 
 	if(_pica_basicP && !isMemoryMapped() )
 	{
-		if(file_cacheH && MatchCacheDateTime(_modtime) && (_path == file_cache_path))
+		const Int64 size = file_size();
+		
 		{
-			adopt_cache();
+			IlmThread::Lock lock(file_cache_mutex);
+			
+			FileCacheEntry *entry = FindFileCache(_path, _modtime);
+			
+			if(entry)
+			{
+				adopt_cache(entry);
+				
+				if( isMemoryMapped() )
+					return;
+			}
+			
+			MakeFileCacheRoom(_pica_basicP, size);
 		}
-		else
+		
+		// read the file without holding up everybody else's streams
+		AEGP_SuiteHandler suites(_pica_basicP);
+		
+		AEGP_MemHandle memH = NULL;
+		
+		suites.MemorySuite()->AEGP_NewMemHandle(S_mem_id, "File Cache", size, AEGP_MemFlag_NONE, &memH);
+		
+		if(memH)
 		{
-			_vsize = file_size();
+			void *file = NULL;
+			
+			suites.MemorySuite()->AEGP_LockMemHandle(memH, (void**)&file);
 			
-			_vfile = NewFileCache(_pica_basicP, _vsize);
+			const Int64 offset = tellg_file();
 			
-			if(_vfile)
+			bool success = (file != NULL);
+			
+			try{
+				if(success)
+				{
+					seekg_file(0);
+					
+					success = read_file((char *)file, size);
+					
+					seekg_file(offset);
+				}
+			}
+			catch(...) { success = false; }
+			
+			bool cached = false;
+			
+			if(success)
 			{
-				_voffset = tellg_file();
+				IlmThread::Lock lock(file_cache_mutex);
 				
-				seekg_file(0);
+				// another stream may have cached it while we were reading
+				FileCacheEntry *existing = FindFileCache(_path, _modtime);
 				
-				read_file((char *)_vfile, _vsize);
+				if(existing)
+				{
+					adopt_cache(existing);
+					
+					if(!isMemoryMapped() && existing->pins == 0)
+					{
+						// can't get at that one, so ours takes its place
+						FreeFileCache(_pica_basicP, std::find(file_cache.begin(), file_cache.end(), existing));
+						
+						existing = NULL;
+					}
+				}
 				
-				file_cache_path = _path;
+				if(existing == NULL)
+				{
+					FileCacheEntry *entry = new FileCacheEntry;
+					
+					entry->memH = memH;
+					entry->path = _path;
+					entry->date_time = _modtime;
+					entry->size = size;
+					entry->last_access = time(NULL);
+					entry->pins = 1; // us
+					
+					file_cache.push_front(entry);
+					
+					file_cache_bytes += size;
+					
+					_cache = entry;
+					_vfile = file;
+					_vsize = size;
+					_voffset = offset;
+					
+					cached = true;
+				}
 				
-				file_cache_date_time = _modtime;
+				// otherwise we're using theirs, or it's pinned by streams
+				// that have it and we just read from the file
+			}
+			
+			if(!cached)
+			{
+				if(file)
+					suites.MemorySuite()->AEGP_UnlockMemHandle(memH);
 				
-				seekg_file(_voffset);
+				suites.MemorySuite()->AEGP_FreeMemHandle(memH);
 			}
 		}
 	}
@@ -282,24 +437,30 @@ IStreamPlatform::unMemoryMap()
 	{
 		//seekg_file(_voffset); // use if you want to still access the file
 		
-		UnlockFileCache(_pica_basicP);
+		IlmThread::Lock lock(file_cache_mutex);
+		
+		UnpinFileCache(_pica_basicP, _cache);
 		
+		_cache = NULL;
 		_vfile = NULL;
 	}
 }
 
 
 void
-IStreamPlatform::adopt_cache()
+IStreamPlatform::adopt_cache(FileCacheEntry *entry)
 {
-	if(file_cacheH == NULL)
-		throw LogicExc("Can't adopt a NULL cache.");
-
-	_vfile = LockFileCache(_pica_basicP);
-	
-	_voffset = tellg_file();
+	// file_cache_mutex is locked
+	_vfile = PinFileCache(_pica_basicP, entry);
 	
-	_vsize = file_cache_size;
+	if(_vfile)
+	{
+		_cache = entry;
+		
+		_voffset = tellg_file();
+		
+		_vsize = _cache->size;
+	}
 }
 
 
@@ -74,7 +74,15 @@ class PathString
 };
 
 
+// Whole files read in by IStreamPlatform::memoryMap(), kept for the next
+// stream that opens the same file (same path and mod time).  The least
+// recently used ones get freed to stay under the budget, and DeleteFileCache()
+// frees the ones nobody has used for timeout seconds (0 for all of them).
+// Files a stream is still reading from are never freed.
 void DeleteFileCache(const SPBasicSuite *pica_basicP, int timeout=0);
+void SetFileCacheBudget(const SPBasicSuite *pica_basicP, Imf::Int64 bytes);
+
+struct FileCacheEntry;
 
 
 class IStreamPlatform : public Imf::IStream
@@ -101,7 +109,7 @@ class IStreamPlatform : public Imf::IStream
 	DateTime getModTime() const { return _modtime; }
 	
   private:
-	void adopt_cache();
+	void adopt_cache(FileCacheEntry *entry);
 	void release_cache();
 
   private:
@@ -118,6 +126,7 @@ class IStreamPlatform : public Imf::IStream
   private:
 	const SPBasicSuite *_pica_basicP;
 	void *_vfile;
+	FileCacheEntry *_cache;
 	Imf::Int64 _voffset;
 	Imf::Int64 _vsize;
 
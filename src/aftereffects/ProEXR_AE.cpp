@@ -24,6 +24,7 @@
 #include "ProEXR_AE.h"
 #include "OpenEXR_PlatformIO.h"
 #include "iccProfileAttribute.h"
+#include "ProEXR_WriteBehindOStream.h"
 
 #include "ProEXRdoc_AE.h"
 #include "ProEXR_AE_Dialogs.h"
@@ -32,6 +33,10 @@
 
 #include <IlmThread.h>
 #include <IlmThreadPool.h>
+#include <IlmThreadMutex.h>
+#include <IlmThreadSemaphore.h>
+
+#include <memory>
 	
 
 #include <assert.h>
@@ -58,6 +63,140 @@ unsigned int gNumCPUs = 1;
 // our prefs
 A_Boolean gStorePersonal = FALSE;
 A_Boolean gStoreMachine = FALSE;
+A_Boolean gBackgroundWrite = FALSE;
+
+
+#pragma mark-
+
+// With the "Write Frames In Background" pref on, ProEXR_OutputFile renders
+// the layers and copies them into the doc as usual, then hands the doc to
+// gFrameWritePool to compress and write while AE goes on to the next frame.
+// Anything that calls AE stays on AE's thread, and that includes deleting
+// the doc (its suite handler releases suites), so finished frames wait in
+// gFinishedFrames until the next frame, AEIO_Flush or the death hook.
+
+static const int kMaxQueuedFrames = 2; // each one holds a whole frame of every layer
+
+class QueuedFrame
+{
+  public:
+	QueuedFrame(const A_PathType *file_pathZ, const Header &hdr) :
+		header(hdr),
+		file_stream( new OStreamPlatform(file_pathZ) ),
+		stream( new WriteBehindOStream(*file_stream) )
+	{}
+	
+	Header header; // the doc keeps a reference to this
+	auto_ptr<OStreamPlatform> file_stream;
+	auto_ptr<WriteBehindOStream> stream;
+	auto_ptr<ProEXRdoc_writeAE> doc;
+	
+	string error;
+};
+
+static IlmThread::ThreadPool *gFrameWritePool = NULL;
+static IlmThread::TaskGroup *gFrameWriteGroup = NULL;
+static IlmThread::Semaphore gFrameWriteSlots(kMaxQueuedFrames);
+static IlmThread::Mutex gFrameWriteMutex;
+static vector<QueuedFrame *> gFinishedFrames;
+
+
+class FrameWriteTask : public IlmThread::Task
+{
+  public:
+	FrameWriteTask(IlmThread::TaskGroup *group, QueuedFrame *frame) : IlmThread::Task(group), _frame(frame) {}
+	virtual ~FrameWriteTask() {}
+	
+	virtual void execute();
+	
+  private:
+	QueuedFrame *_frame;
+};
+
+
+void
+FrameWriteTask::execute()
+{
+	try
+	{
+		_frame->doc->writeFile();
+		
+		_frame->stream->flush();
+	}
+	catch(const std::exception &e)
+	{
+		_frame->error = e.what();
+	}
+	catch(...)
+	{
+		_frame->error = "Error writing file.";
+	}
+	
+	// everything but the doc itself can go now, closing the file
+	_frame->doc->freeBuffers();
+	
+	_frame->stream.reset();
+	_frame->file_stream.reset();
+	
+	{
+		IlmThread::Lock lock(gFrameWriteMutex);
+		
+		gFinishedFrames.push_back(_frame);
+	}
+	
+	gFrameWriteSlots.post();
+}
+
+
+static void
+QueueFrame(QueuedFrame *frame)
+{
+	if(gFrameWritePool == NULL)
+	{
+		gFrameWritePool = new IlmThread::ThreadPool(1); // one frame at a time, the global pool does the compressing
+		gFrameWriteGroup = new IlmThread::TaskGroup;
+	}
+	
+	gFrameWritePool->addTask( new FrameWriteTask(gFrameWriteGroup, frame) );
+}
+
+
+static string
+FinishQueuedFrames(bool wait)
+{
+	// call on AE's thread, returns the first error
+	if(wait && gFrameWriteGroup)
+	{
+		// TaskGroup's destructor waits for its tasks
+		delete gFrameWriteGroup;
+		
+		gFrameWriteGroup = new IlmThread::TaskGroup;
+	}
+	
+	vector<QueuedFrame *> finished;
+	
+	{
+		IlmThread::Lock lock(gFrameWriteMutex);
+		
+		finished.swap(gFinishedFrames);
+	}
+	
+	string error;
+	
+	for(vector<QueuedFrame *>::iterator i = finished.begin(); i != finished.end(); ++i)
+	{
+		if( error.empty() )
+			error = (*i)->error;
+		
+		delete *i;
+	}
+	
+	return error;
+}
+
+
+#pragma mark-
+
 
 
 A_Err
@@ -69,6 +208,7 @@ ProEXR_Init(struct SPBasicSuite *pica_basicP)
 #define PREFS_SECTION		"ProEXR"
 #define PREFS_PERSONAL_INFO	"Store Personal Info"
 #define PREFS_MACHINE_INFO	"Store Machine Info"
+#define PREFS_BACKGROUND_WRITE	"Write Frames In Background"
 	
 	AEGP_SuiteHandler suites(pica_basicP);
 	
@@ -78,12 +218,15 @@ ProEXR_Init(struct SPBasicSuite *pica_basicP)
 	A_long store_personal = 0;
 	A_long store_machine = 0;
 	A_long file_description = 1;
+	A_long background_write = 0;
 	
 	suites.PersistentDataSuite()->AEGP_GetLong(blobH, PREFS_SECTION, PREFS_PERSONAL_INFO, store_personal, &store_personal);
 	suites.PersistentDataSuite()->AEGP_GetLong(blobH, PREFS_SECTION, PREFS_MACHINE_INFO, store_machine, &store_machine);
+	suites.PersistentDataSuite()->AEGP_GetLong(blobH, PREFS_SECTION, PREFS_BACKGROUND_WRITE, background_write, &background_write);
 	
 	gStorePersonal = (store_personal ? TRUE : FALSE);
 	gStoreMachine = (store_machine ? TRUE : FALSE);
+	gBackgroundWrite = (background_write ? TRUE : FALSE);
 
 	if( IlmThread::supportsThreads() )
 	{
@@ -113,6 +256,15 @@ A_Err
 ProEXR_DeathHook(const SPBasicSuite *pica_basicP)
 {
 	try {
+		// nowhere left to report errors, but the frames still get finished
+		FinishQueuedFrames(true);
+		
+		delete gFrameWriteGroup;
+		delete gFrameWritePool;
+		
+		gFrameWriteGroup = NULL;
+		gFrameWritePool = NULL;
+		
 		if( IlmThread::supportsThreads() )
 			setGlobalThreadCount(0);
 		
@@ -123,6 +275,19 @@ ProEXR_DeathHook(const SPBasicSuite *pica_basicP)
 }
 
 
+A_Err
+ProEXR_Flush()
+{
+	// wait for the frames still being written
+	try {
+		if( !FinishQueuedFrames(true).empty() )
+			return AEIO_Err_DISK_FULL;
+	}catch(...) { return AEIO_Err_DISK_FULL; }
+	
+	return A_Err_NONE;
+}
+
+
 A_Err
 ProEXR_ConstructModuleInfo(
 	AEIO_ModuleInfo	*info)
@@ -212,6 +377,8 @@ ProEXR_InitOutOptions(
 	options->float_not_half = FALSE;
 	options->layer_composite = TRUE;
 	options->hidden_layers = FALSE;
+	options->tile_size_log2 = 0;
+	options->mip_levels = 0;
 
 	return err;
 }
@@ -385,6 +552,10 @@ ProEXR_OutputFile(
 
 	try{
 	
+	// frames written in the background report in here
+	if( !FinishQueuedFrames(false).empty() )
+		return AEIO_Err_DISK_FULL;
+	
 	if( IlmThread::supportsThreads() )
 		setGlobalThreadCount(gNumCPUs);
 		
@@ -408,6 +579,16 @@ ProEXR_OutputFile(
 						RationalAttribute( Rational(info->pixel_aspect_ratio.num, info->pixel_aspect_ratio.den) ) );
 	}
 	
+	// tiles (ProEXRdoc_write makes the mipmaps)
+	if(options->tile_size_log2)
+	{
+		const int tile_size = (1 << options->tile_size_log2);
+		
+		header.setTileDescription( TileDescription(tile_size, tile_size,
+											(options->mip_levels ? MIPMAP_LEVELS : ONE_LEVEL),
+											(options->mip_levels ? (LevelRoundingMode)(options->mip_levels - 1) : ROUND_DOWN)) );
+	}
+	
 	// store ICC Profile
 	if(info->icc_profile && info->icc_profile_len)
 	{
@@ -633,18 +814,51 @@ ProEXR_OutputFile(
 	
 	
 	// write file
-	OStreamPlatform outstream(file_pathZ);
-	
-	ProEXRdoc_writeAE outputFile(outstream, header, basic_dataP, outH, pixel_type, options->hidden_layers);
-	
-	if(options->layer_composite)
-		outputFile.addMainLayer((PF_PixelFloat *)wP->data, wP->rowbytes, pixel_type);
-	
-	outputFile.loadFromAE(&params);
-	
-	outputFile.writeFile();
-	
-	outputFile.restoreLayers();
+	if(gBackgroundWrite && IlmThread::supportsThreads())
+	{
+		gFrameWriteSlots.wait(); // only so many frames in memory at once
+		
+		try
+		{
+			auto_ptr<QueuedFrame> frame( new QueuedFrame(file_pathZ, header) );
+			
+			frame->doc.reset( new ProEXRdoc_writeAE(*frame->stream, frame->header, basic_dataP, outH, pixel_type, options->hidden_layers) );
+			
+			if(options->layer_composite)
+				frame->doc->addMainLayer((PF_PixelFloat *)wP->data, wP->rowbytes, pixel_type);
+			
+			frame->doc->loadFromAE(&params); // the pixels are copied, AE can have its world back
+			
+			frame->doc->restoreLayers();
+			
+			QueueFrame( frame.release() );
+		}
+		catch(...)
+		{
+			gFrameWriteSlots.post();
+			
+			throw;
+		}
+	}
+	else
+	{
+		OStreamPlatform file_stream(file_pathZ);
+		
+		WriteBehindOStream outstream(file_stream); // big writes on another thread while we compress
+		
+		ProEXRdoc_writeAE outputFile(outstream, header, basic_dataP, outH, pixel_type, options->hidden_layers);
+		
+		if(options->layer_composite)
+			outputFile.addMainLayer((PF_PixelFloat *)wP->data, wP->rowbytes, pixel_type);
+		
+		outputFile.loadFromAE(&params);
+		
+		outputFile.writeFile();
+		
+		outstream.flush(); // write errors come out here
+		
+		outputFile.restoreLayers();
+	}
 	
 	}catch(...) { err = AEIO_Err_DISK_FULL; }
 	
@@ -664,6 +878,8 @@ ProEXR_WriteOptionsDialog(
 	params.float_not_half	= options->float_not_half;
 	params.layer_composite	= options->layer_composite;
 	params.hidden_layers	= options->hidden_layers;
+	params.tile_size		= (options->tile_size_log2 ? (1 << options->tile_size_log2) : 0);
+	params.mip_levels		= options->mip_levels;
 
 #ifdef MAC_ENV
 	const char *plugHndl = "com.fnordware.AfterEffects.ProEXR_AE";
@@ -685,6 +901,11 @@ ProEXR_WriteOptionsDialog(
 		options->float_not_half		= params.float_not_half;
 		options->layer_composite	= params.layer_composite;
 		options->hidden_layers		= params.hidden_layers;
+		options->tile_size_log2		= 0;
+		options->mip_levels			= params.mip_levels;
+		
+		while(params.tile_size > (1 << options->tile_size_log2))
+			options->tile_size_log2++;
 	}
 
 
@@ -764,6 +985,18 @@ ProEXR_GetOutSpecInfo(
 	if(options->float_not_half)
 		strcat(verbiageP->sub_type, "\n32-bit float");
 	
+	if(options->tile_size_log2)
+	{
+		char tile_str[64];
+		
+		sprintf(tile_str, "\n%dx%d tiles", (1 << options->tile_size_log2), (1 << options->tile_size_log2));
+		
+		strcat(verbiageP->sub_type, tile_str);
+		
+		if(options->mip_levels)
+			strcat(verbiageP->sub_type, "\nMipmaps");
+	}
+	
 	
 	return err;
 }
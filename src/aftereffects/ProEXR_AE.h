@@ -41,7 +41,9 @@ typedef struct ProEXR_outData
 	A_Boolean	float_not_half;
 	A_Boolean	layer_composite;
 	A_Boolean	hidden_layers;
-	char		reserved[60]; // total of 64 bytes
+	A_u_char	tile_size_log2; // 0 for scanlines, else 5-8 for 32-256 pixel tiles
+	A_u_char	mip_levels; // 0 for none, else Imf::LevelRoundingMode + 1
+	char		reserved[58]; // total of 64 bytes
 } ProEXR_outData;
 
 
@@ -72,6 +74,9 @@ ProEXR_OutputFile(
 	ProEXR_outData	*options,
 	PF_EffectWorld		*wP);
 
+A_Err
+ProEXR_Flush();
+
 A_Err	
 ProEXR_WriteOptionsDialog(
 	AEIO_BasicData		*basic_dataP,
@@ -296,7 +296,7 @@ AEIO_Flush(
 	/*	free any temp buffers you kept around for
 		writing.
 	*/
-	return A_Err_NONE; 
+	return FrameSeq_Flush(basic_dataP, outH); 
 };
 
 static A_Err	
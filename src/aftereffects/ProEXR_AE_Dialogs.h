@@ -31,6 +31,8 @@ typedef struct {
 	bool float_not_half;
 	bool layer_composite;
 	bool hidden_layers;
+	int tile_size; // 0 for scanlines
+	int mip_levels; // 0 = none, 1 = round down, 2 = round up
 } ProEXR_AE_Out_Data;
 
 bool
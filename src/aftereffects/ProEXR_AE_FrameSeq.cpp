@@ -874,6 +874,16 @@ FrameSeq_GetFlatOutputOptions(
 }
 
 
+A_Err
+FrameSeq_Flush(
+	AEIO_BasicData	*basic_dataP,
+	AEIO_OutSpecH	outH)
+{
+	// frames written in the background have to be done now
+	return ProEXR_Flush();
+}
+
+
 A_Err
 FrameSeq_DeathHook(const SPBasicSuite *pica_basicP)
 {
@@ -167,6 +167,11 @@ FrameSeq_GetFlatOutputOptions(
 	AEIO_OutSpecH	outH, 
 	AEIO_Handle		*flat_optionsPH);
 	
+A_Err
+FrameSeq_Flush(
+	AEIO_BasicData	*basic_dataP,
+	AEIO_OutSpecH	outH);
+
 A_Err
 FrameSeq_DeathHook(const SPBasicSuite *pica_basicP);
 
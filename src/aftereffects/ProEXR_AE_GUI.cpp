@@ -27,6 +27,7 @@
 
 #include "OpenEXR_PlatformIO.h"
 #include "iccProfileAttribute.h"
+#include "ProEXR_WriteBehindOStream.h"
 
 #include <ImfStandardAttributes.h>
 
@@ -594,7 +595,9 @@ ProEXR_GPCommandHook(
 						const Imf::PixelType pixelType = (params.float_not_half ? Imf::FLOAT : Imf::HALF);
 						
 						
-						OStreamPlatform outstream(frame_path.c_str());
+						OStreamPlatform file_stream(frame_path.c_str());
+						
+						WriteBehindOStream outstream(file_stream); // big writes on another thread while we compress
 						
 						ProEXRdoc_writeAE outputFile(outstream, header, sP, compH, pixelType, params.hidden_layers);
 						
@@ -605,6 +608,8 @@ ProEXR_GPCommandHook(
 						
 						outputFile.writeFile();
 						
+						outstream.flush(); // write errors come out here
+						
 						outputFile.restoreLayers();
 					}
 					
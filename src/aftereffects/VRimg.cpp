@@ -53,6 +53,7 @@ extern unsigned int gNumCPUs;
 static A_long gChannelCaches = 3;
 static A_long gCacheTimeout = 30;
 static A_Boolean gMemoryMap = FALSE;
+static A_long gFileCacheMegabytes = 1024;
 
 
 static VRimg_CachePool gCachePool;
@@ -72,22 +73,28 @@ VRimg_Init(struct SPBasicSuite *pica_basicP)
 #define PREFS_CHANNEL_CACHES "Channel Caches Number"
 #define PREFS_CACHE_EXPIRATION "Channel Cache Expiration"
 #define PREFS_MEMORY_MAP	"Memory Map"
+#define PREFS_FILE_CACHE_SIZE	"Memory Map Cache Megabytes"
 
 
 	A_long channel_caches = gChannelCaches;
 	A_long cache_timeout = gCacheTimeout;
 	A_long memory_map = gMemoryMap;
+	A_long file_cache_megabytes = gFileCacheMegabytes;
 	
 	suites.PersistentDataSuite()->AEGP_GetLong(blobH, PREFS_SECTION, PREFS_CHANNEL_CACHES, channel_caches, &channel_caches);
 	suites.PersistentDataSuite()->AEGP_GetLong(blobH, PREFS_SECTION, PREFS_CACHE_EXPIRATION, cache_timeout, &cache_timeout);
 	suites.PersistentDataSuite()->AEGP_GetLong(blobH, PREFS_SECTION, PREFS_MEMORY_MAP, memory_map, &memory_map);
+	suites.PersistentDataSuite()->AEGP_GetLong(blobH, PREFS_SECTION, PREFS_FILE_CACHE_SIZE, file_cache_megabytes, &file_cache_megabytes);
 
 	gChannelCaches = channel_caches;
 	gCacheTimeout = cache_timeout;
 	gMemoryMap = (memory_map ? TRUE : FALSE);
+	gFileCacheMegabytes = file_cache_megabytes;
 	
 	gCachePool.configurePool(gChannelCaches, pica_basicP);
 	
+	SetFileCacheBudget(pica_basicP, (Imf::Int64)gFileCacheMegabytes * 1024 * 1024);
+	
 	return err;
 }
 
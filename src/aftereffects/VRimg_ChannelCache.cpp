@@ -22,6 +22,8 @@
 
 #include "VRimg_ChannelCache.h"
 
+#include "ProEXR_ParallelFor.h"
+
 #include <IexBaseExc.h>
 #include <IlmThreadPool.h>
 
@@ -139,15 +141,14 @@ VRimg_ChannelCache::~VRimg_ChannelCache()
 }
 
 
-class CopyCacheTask : public Task
+class CopyCacheRows : public ParallelRowKernel
 {
   public:
-	CopyCacheTask(TaskGroup *group,
-					const char *buf, int width, VRimg::PixelType pix_type,
-					char *out_buf, size_t rowbytes, int row);
-	virtual ~CopyCacheTask() {}
+	CopyCacheRows(const char *buf, int width, VRimg::PixelType pix_type,
+					char *out_buf, size_t rowbytes);
+	virtual ~CopyCacheRows() {}
 	
-	virtual void execute();
+	virtual void processRows(int y_start, int y_end);
 	
 	template <typename PIXTYPE>
 	static void CopyRow(const char *in, char *out, int width);
@@ -158,27 +159,23 @@ class CopyCacheTask : public Task
 	VRimg::PixelType _pix_type;
 	char *_out_buf;
 	size_t _rowbytes;
-	int _row;
 };
 
 
-CopyCacheTask::CopyCacheTask(TaskGroup *group,
-								const char *buf, int width, VRimg::PixelType pix_type,
-								char *out_buf, size_t rowbytes, int row) :
-	Task(group),
+CopyCacheRows::CopyCacheRows(const char *buf, int width, VRimg::PixelType pix_type,
+								char *out_buf, size_t rowbytes) :
 	_buf(buf),
 	_width(width),
 	_pix_type(pix_type),
 	_out_buf(out_buf),
-	_rowbytes(rowbytes),
-	_row(row)
+	_rowbytes(rowbytes)
 {
 
 }
 
 
 void
-CopyCacheTask::execute()
+CopyCacheRows::processRows(int y_start, int y_end)
 {
 	const size_t pix_size =	_pix_type == VRimg::FLOAT ? sizeof(float) :
 							_pix_type == VRimg::INT ? sizeof(int) :
@@ -186,24 +183,27 @@ CopyCacheTask::execute()
 							
 	const size_t rowbytes = pix_size * _width;
 	
-	const char *in_row = _buf + (rowbytes * _row);
-				
-	char *out_row = _out_buf + (_rowbytes * _row);
-	
-	if(_pix_type == VRimg::FLOAT)
+	for(int y = y_start; y < y_end; y++)
 	{
-		CopyRow<float>(in_row, out_row, _width);
-	}
-	else if(_pix_type == VRimg::INT)
-	{
-		CopyRow<int>(in_row, out_row, _width);
+		const char *in_row = _buf + (rowbytes * y);
+					
+		char *out_row = _out_buf + (_rowbytes * y);
+		
+		if(_pix_type == VRimg::FLOAT)
+		{
+			CopyRow<float>(in_row, out_row, _width);
+		}
+		else if(_pix_type == VRimg::INT)
+		{
+			CopyRow<int>(in_row, out_row, _width);
+		}
 	}
 }
 
 
 template <typename PIXTYPE>
 void
-CopyCacheTask::CopyRow(const char *in, char *out, int width)
+CopyCacheRows::CopyRow(const char *in, char *out, int width)
 {
 	PIXTYPE *i = (PIXTYPE *)in;
 	PIXTYPE *o = (PIXTYPE *)out;
@@ -224,7 +224,7 @@ VRimg_ChannelCache::copyLayerToBuffer(const string &name, void *buf, size_t rowb
 	
 	vector<AEIO_Handle> locked_handles;
 
-	if(true) // making a scope for TaskGroup
+	if(true) // making a scope
 	{
 		const ChannelCache &cache = _cache[ name ];
 		
@@ -244,14 +244,9 @@ VRimg_ChannelCache::copyLayerToBuffer(const string &name, void *buf, size_t rowb
 		locked_handles.push_back(cache.bufH);
 		
 		
-		TaskGroup group;
+		CopyCacheRows rows(cache_buf, _width * cache.dimensions, cache.pix_type, (char *)buf, rowbytes);
 		
-		for(int y=0; y < _height; y++)
-		{
-			ThreadPool::addGlobalTask(new CopyCacheTask(&group,
-													cache_buf, _width * cache.dimensions, cache.pix_type,
-													(char *)buf, rowbytes, y) );
-		}
+		ParallelForRows(rows, _height, (sizeof(float) * _width * cache.dimensions) + rowbytes);
 	}
 	
 	
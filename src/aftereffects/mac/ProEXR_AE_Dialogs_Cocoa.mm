@@ -58,7 +58,9 @@ ProEXR_AE_Out(
 		ProEXR_AE_Out_Controller *ui_controller = [[ui_controller_class alloc] init:params->compression
 																				useFloat:params->float_not_half
 																				composite:params->layer_composite
-																				hidden:params->hidden_layers];
+																				hidden:params->hidden_layers
+																				tileSize:params->tile_size
+																				mipLevels:params->mip_levels];
 		
 		if(ui_controller)
 		{
@@ -92,6 +94,8 @@ ProEXR_AE_Out(
 					params->float_not_half = [ui_controller getFloat];
 					params->layer_composite = [ui_controller getComposite];
 					params->hidden_layers = [ui_controller getHidden];
+					params->tile_size = [ui_controller getTileSize];
+					params->mip_levels = [ui_controller getMipLevels];
 					
 					result = true;
 				}
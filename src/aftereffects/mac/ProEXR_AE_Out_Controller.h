@@ -38,6 +38,8 @@ typedef enum {
     IBOutlet NSButton *floatCheck;
     IBOutlet NSButton *compositeCheck;
     IBOutlet NSButton *hiddenCheck;
+    IBOutlet NSPopUpButton *tileMenu;
+    IBOutlet NSPopUpButton *mipmapMenu;
     IBOutlet NSWindow *theWindow;
 	
 	DialogResult theResult;
@@ -46,16 +48,21 @@ typedef enum {
 - (id)init:(NSInteger)compression
 	useFloat:(BOOL)floatVal
 	composite:(BOOL)compositeVal 
-	hidden:(BOOL)hiddenVal;
+	hidden:(BOOL)hiddenVal
+	tileSize:(NSInteger)tileSize
+	mipLevels:(NSInteger)mipLevels;
 				
 - (IBAction)clickedCancel:(id)sender;
 - (IBAction)clickedOK:(id)sender;
+- (IBAction)trackTileMenu:(id)sender;
 - (DialogResult)getResult;
 
 - (NSInteger)getCompression;
 - (BOOL)getFloat;
 - (BOOL)getComposite;
 - (BOOL)getHidden;
+- (NSInteger)getTileSize;
+- (NSInteger)getMipLevels;
 
 - (NSWindow *)getWindow;
 
@@ -28,6 +28,8 @@
 	useFloat:(BOOL)floatVal
 	composite:(BOOL)compositeVal 
 	hidden:(BOOL)hiddenVal
+	tileSize:(NSInteger)tileSize
+	mipLevels:(NSInteger)mipLevels
 {
 	self = [super init];
 	
@@ -45,6 +47,24 @@
 	[compositeCheck setState:(compositeVal ? NSOnState : NSOffState)];
 	[hiddenCheck setState:(hiddenVal ? NSOnState : NSOffState)];
 	
+	// menu item tags are the tile sizes
+	[tileMenu removeAllItems];
+	[tileMenu addItemsWithTitles:
+		[NSArray arrayWithObjects:@"Scanlines", @"32x32", @"64x64", @"128x128", @"256x256", nil]];
+	[[tileMenu itemAtIndex:0] setTag:0];
+	[[tileMenu itemAtIndex:1] setTag:32];
+	[[tileMenu itemAtIndex:2] setTag:64];
+	[[tileMenu itemAtIndex:3] setTag:128];
+	[[tileMenu itemAtIndex:4] setTag:256];
+	[tileMenu selectItemWithTag:tileSize];
+	
+	[mipmapMenu removeAllItems];
+	[mipmapMenu addItemsWithTitles:
+		[NSArray arrayWithObjects:@"None", @"Round Down", @"Round Up", nil]];
+	[mipmapMenu selectItem:[mipmapMenu itemAtIndex:mipLevels]];
+	
+	[self trackTileMenu:self];
+	
 	theResult = DIALOG_RESULT_CONTINUE;
 		
 	return self;
@@ -58,6 +78,11 @@
     theResult = DIALOG_RESULT_OK;
 }
 
+- (IBAction)trackTileMenu:(id)sender {
+	// mipmaps need tiles
+	[mipmapMenu setEnabled:([[tileMenu selectedItem] tag] != 0)];
+}
+
 - (DialogResult)getResult {
 	return theResult;
 }
@@ -78,6 +103,14 @@
 	return ([hiddenCheck state] == NSOnState);
 }
 
+- (NSInteger)getTileSize {
+	return [[tileMenu selectedItem] tag];
+}
+
+- (NSInteger)getMipLevels {
+	return [mipmapMenu indexOfSelectedItem];
+}
+
 - (NSWindow *)getWindow {
 	return theWindow;
 }
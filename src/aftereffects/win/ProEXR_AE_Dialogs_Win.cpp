@@ -63,7 +63,9 @@ enum {
 	OUT_Compression_Menu = 3,
 	OUT_Float_Check,
 	OUT_Composite_Check,
-	OUT_Hidden_Layers_Check
+	OUT_Hidden_Layers_Check,
+	OUT_Tiles_Menu,
+	OUT_Mipmaps_Menu
 };
 
 
@@ -92,6 +94,8 @@ static int	g_Compression	= OUT_PIZ_COMPRESSION;
 static bool	g_32bit_float	= FALSE;
 static bool	g_composite		= FALSE;
 static bool	g_hidden_layers	= FALSE;
+static int	g_tile_size		= 0;
+static int	g_mip_levels	= 0;
 
 
 static BOOL CALLBACK DialogProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARAM lParam) 
@@ -132,6 +136,21 @@ static BOOL CALLBACK DialogProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARA
 			SendMessage(GetDlgItem(hwndDlg, OUT_Composite_Check), BM_SETCHECK, (WPARAM)g_composite, (LPARAM)0);
 			SendMessage(GetDlgItem(hwndDlg, OUT_Hidden_Layers_Check), BM_SETCHECK, (WPARAM)g_hidden_layers, (LPARAM)0);
 
+			do{
+				// item data is the tile size, 0 for scanlines
+				ADD_MENU_ITEM(OUT_Tiles_Menu, 0, "Scanlines", 0, (g_tile_size == 0));
+				ADD_MENU_ITEM(OUT_Tiles_Menu, 1, "32x32", 32, (g_tile_size == 32));
+				ADD_MENU_ITEM(OUT_Tiles_Menu, 2, "64x64", 64, (g_tile_size == 64));
+				ADD_MENU_ITEM(OUT_Tiles_Menu, 3, "128x128", 128, (g_tile_size == 128));
+				ADD_MENU_ITEM(OUT_Tiles_Menu, 4, "256x256", 256, (g_tile_size == 256));
+
+				ADD_MENU_ITEM(OUT_Mipmaps_Menu, 0, "None", 0, (g_mip_levels == 0));
+				ADD_MENU_ITEM(OUT_Mipmaps_Menu, 1, "Round Down", 1, (g_mip_levels == 1));
+				ADD_MENU_ITEM(OUT_Mipmaps_Menu, 2, "Round Up", 2, (g_mip_levels == 2));
+
+				ENABLE_ITEM(OUT_Mipmaps_Menu, (g_tile_size != 0));
+			}while(0);
+
 
 			return TRUE;
 
@@ -152,6 +171,8 @@ static BOOL CALLBACK DialogProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARA
 						g_32bit_float = SendMessage(GetDlgItem(hwndDlg, OUT_Float_Check), BM_GETCHECK, (WPARAM)0, (LPARAM)0);
 						g_composite = SendMessage(GetDlgItem(hwndDlg, OUT_Composite_Check), BM_GETCHECK, (WPARAM)0, (LPARAM)0);
 						g_hidden_layers = SendMessage(GetDlgItem(hwndDlg, OUT_Hidden_Layers_Check), BM_GETCHECK, (WPARAM)0, (LPARAM)0);
+						g_tile_size = GET_MENU_VALUE(OUT_Tiles_Menu);
+						g_mip_levels = GET_MENU_VALUE(OUT_Mipmaps_Menu);
 
 					}while(0);
 
@@ -160,6 +181,13 @@ static BOOL CALLBACK DialogProc(HWND hwndDlg, UINT message, WPARAM wParam, LPARA
                     //DestroyWindow(hwndDlg); 
 
                     return TRUE;
+
+				case OUT_Tiles_Menu:
+					// mipmaps need tiles
+					if(HIWORD(wParam) == CBN_SELCHANGE)
+						ENABLE_ITEM(OUT_Mipmaps_Menu, (GET_MENU_VALUE(OUT_Tiles_Menu) != 0));
+
+					return TRUE;
             } 
     } 
 
@@ -179,6 +207,8 @@ ProEXR_AE_Out(
 	g_32bit_float = params->float_not_half;
 	g_composite = params->layer_composite;
 	g_hidden_layers = params->hidden_layers;
+	g_tile_size = params->tile_size;
+	g_mip_levels = params->mip_levels;
 
 
 	int status = DialogBox((HINSTANCE)hDllInstance, (LPSTR)"OUTDIALOG", (HWND)mwnd, (DLGPROC)DialogProc);
@@ -190,6 +220,8 @@ ProEXR_AE_Out(
 		params->float_not_half = g_32bit_float;
 		params->layer_composite = g_composite;
 		params->hidden_layers = g_hidden_layers;
+		params->tile_size = g_tile_size;
+		params->mip_levels = g_mip_levels;
 
 		hit_ok = true;
 	}
@@ -0,0 +1,870 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+// proexr-bench
+//
+// Times the ProEXRdoc load, post-process and write paths on synthetic
+// files generated in memory, for each compression type and thread count.
+
+#include "ProEXRdoc.h"
+#include "ProEXR_PixelKernels.h"
+
+#include <ImfMultiPartOutputFile.h>
+#include <ImfOutputPart.h>
+#include <ImfTiledOutputFile.h>
+#include <ImfPartType.h>
+#include <ImfThreading.h>
+#include <ImfArray.h>
+
+#include <IlmThread.h>
+
+#include <Iex.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <limits>
+#include <memory>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <assert.h>
+
+using namespace Imf;
+using namespace Imath;
+using namespace Iex;
+using namespace IlmThread;
+using namespace std;
+
+
+#pragma mark-
+
+
+// the corpus lives in memory so we're timing ProEXR and OpenEXR, not the disk
+class MemoryOStream : public OStream
+{
+  public:
+	MemoryOStream() : OStream("Memory File"), _pos(0) {}
+	virtual ~MemoryOStream() {}
+
+	virtual void write(const char c[/*n*/], int n);
+	virtual Int64 tellp() { return _pos; }
+	virtual void seekp(Int64 pos) { _pos = pos; }
+
+	const vector<char> & data() const { return _data; }
+
+  private:
+	vector<char> _data;
+	Int64 _pos;
+};
+
+void
+MemoryOStream::write(const char c[/*n*/], int n)
+{
+	if(_pos + n > _data.size())
+		_data.resize(_pos + n);
+
+	memcpy(&_data[_pos], c, n);
+
+	_pos += n;
+}
+
+
+class MemoryIStream : public IStream
+{
+  public:
+	MemoryIStream(const vector<char> &data) : IStream("Memory File"), _data(data), _pos(0) {}
+	virtual ~MemoryIStream() {}
+
+	virtual bool isMemoryMapped() const { return true; }
+	virtual bool read(char c[/*n*/], int n);
+	virtual char *readMemoryMapped(int n);
+	virtual Int64 tellg() { return _pos; }
+	virtual void seekg(Int64 pos) { _pos = pos; }
+
+  private:
+	const vector<char> &_data;
+	Int64 _pos;
+};
+
+bool
+MemoryIStream::read(char c[/*n*/], int n)
+{
+	memcpy(c, readMemoryMapped(n), n);
+
+	return (_pos < _data.size());
+}
+
+char *
+MemoryIStream::readMemoryMapped(int n)
+{
+	if(_pos + n > _data.size())
+		throw InputExc("Reading past end of memory file.");
+
+	char *ptr = (char *)&_data[_pos];
+
+	_pos += n;
+
+	return ptr;
+}
+
+
+#pragma mark-
+
+
+static double
+Now()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (double)tv.tv_sec + ((double)tv.tv_usec / 1000000.0);
+}
+
+
+// peak resident set size in bytes, and a way to start counting over (Linux only)
+static void
+ResetPeakRSS()
+{
+	ofstream clear_refs("/proc/self/clear_refs");
+
+	if(clear_refs)
+		clear_refs << "5";
+}
+
+static Int64
+PeakRSS()
+{
+	ifstream status("/proc/self/status");
+
+	string line;
+
+	while( getline(status, line) )
+	{
+		if(line.compare(0, 6, "VmHWM:") == 0)
+		{
+			istringstream kb( line.substr(6) );
+
+			Int64 val = 0;
+			kb >> val;
+
+			return (val * 1024);
+		}
+	}
+
+	struct rusage usage;
+
+	if(getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+	#ifdef __APPLE__
+		return usage.ru_maxrss;
+	#else
+		return ((Int64)usage.ru_maxrss * 1024);
+	#endif
+	}
+
+	return 0;
+}
+
+
+static int
+NumCPUs()
+{
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (cpus > 0 ? cpus : 1);
+}
+
+
+#pragma mark-
+
+
+// synthetic pixels: smooth gradients with a little grain, so the compressors
+// have something realistic to chew on, and the occasional NaN/inf for killNaN()
+static inline unsigned int
+Hash(unsigned int x, unsigned int y, unsigned int c)
+{
+	unsigned int h = (x * 73856093u) ^ (y * 19349663u) ^ (c * 83492791u);
+
+	h ^= h >> 13;
+	h *= 0x5bd1e995u;
+	h ^= h >> 15;
+
+	return h;
+}
+
+static float
+SampleValue(int x, int y, int c, bool alpha)
+{
+	const unsigned int h = Hash(x, y, c);
+
+	if(alpha)
+	{
+		// solid, transparent, and a soft edge in between
+		const float ramp = (float)(x % 512) / 256.0f - 0.5f;
+
+		return (ramp < 0.f ? 0.f : ramp > 1.f ? 1.f : ramp);
+	}
+	else if((h & 0xfff) == 0)
+	{
+		return ((h & 0x1000) ? numeric_limits<float>::quiet_NaN() : numeric_limits<float>::infinity());
+	}
+	else
+	{
+		const float grain = (float)(h & 0xff) / 255.0f * 0.02f;
+
+		return 0.5f + 0.4f * sinf(x * 0.01f * (c + 1)) * cosf(y * 0.013f) + grain;
+	}
+}
+
+static unsigned int
+SampleID(int x, int y, int c)
+{
+	return (((x / 64) + (y / 64) * 37 + c * 11) % 97);
+}
+
+
+typedef struct BenchChannel {
+	string name;
+	Imf::PixelType type;
+	bool alpha;
+
+	BenchChannel(const string &n, Imf::PixelType t, bool a=false) : name(n), type(t), alpha(a) {}
+} BenchChannel;
+
+
+static vector<BenchChannel>
+AOVChannels(int aov_layers, bool uint_ids)
+{
+	vector<BenchChannel> chans;
+
+	chans.push_back( BenchChannel("R", Imf::HALF) );
+	chans.push_back( BenchChannel("G", Imf::HALF) );
+	chans.push_back( BenchChannel("B", Imf::HALF) );
+	chans.push_back( BenchChannel("A", Imf::HALF, true) );
+
+	for(int i=1; i <= aov_layers; i++)
+	{
+		ostringstream layer;
+		layer << "aov" << setw(2) << setfill('0') << i;
+
+		chans.push_back( BenchChannel(layer.str() + ".R", Imf::HALF) );
+		chans.push_back( BenchChannel(layer.str() + ".G", Imf::HALF) );
+		chans.push_back( BenchChannel(layer.str() + ".B", Imf::HALF) );
+	}
+
+	if(uint_ids)
+	{
+		chans.push_back( BenchChannel("objectId", Imf::UINT) );
+		chans.push_back( BenchChannel("materialId", Imf::UINT) );
+	}
+
+	return chans;
+}
+
+
+static Int64
+PixelBytes(const vector<BenchChannel> &chans, int width, int height)
+{
+	Int64 bytes = 0;
+
+	for(vector<BenchChannel>::const_iterator i = chans.begin(); i != chans.end(); ++i)
+		bytes += (i->type == Imf::HALF ? 2 : 4);
+
+	return (bytes * width * height);
+}
+
+
+static void
+FillChannel(ProEXRchannel &chan, int c, bool alpha)
+{
+	ProEXRbuffer desc = chan.getBufferDesc(false);
+
+	char *row = (char *)desc.buf;
+
+	for(int y=0; y < desc.height; y++)
+	{
+		if(desc.type == Imf::UINT)
+		{
+			unsigned int *pix = (unsigned int *)row;
+
+			for(int x=0; x < desc.width; x++)
+				*pix++ = SampleID(x, y, c);
+		}
+		else
+		{
+			float *pix = (float *)row;
+
+			for(int x=0; x < desc.width; x++)
+				*pix++ = SampleValue(x, y, c, alpha);
+		}
+
+		row += desc.rowbytes;
+	}
+
+	chan.setLoaded(true);
+}
+
+
+// one contiguous plane per channel for the files ProEXRdoc can't write itself
+class PlaneBuffers
+{
+  public:
+	PlaneBuffers(const vector<BenchChannel> &chans, const Box2i &dw);
+	~PlaneBuffers();
+
+	Slice slice(int c) const;
+
+  private:
+	const vector<BenchChannel> &_chans;
+	Box2i _dw;
+	int _width;
+	vector<char *> _planes;
+};
+
+PlaneBuffers::PlaneBuffers(const vector<BenchChannel> &chans, const Box2i &dw) :
+	_chans(chans),
+	_dw(dw),
+	_width((dw.max.x - dw.min.x) + 1)
+{
+	const int height = (dw.max.y - dw.min.y) + 1;
+
+	for(int c=0; c < chans.size(); c++)
+	{
+		const size_t colbytes = (chans[c].type == Imf::HALF ? sizeof(half) : sizeof(float));
+
+		char *plane = (char *)malloc(colbytes * _width * height);
+
+		if(plane == NULL)
+			throw bad_alloc();
+
+		_planes.push_back(plane);
+
+		for(int y=0; y < height; y++)
+		{
+			for(int x=0; x < _width; x++)
+			{
+				const int i = (y * _width) + x;
+
+				if(chans[c].type == Imf::HALF)
+					((half *)plane)[i] = SampleValue(x, y, c, chans[c].alpha);
+				else
+					((unsigned int *)plane)[i] = SampleID(x, y, c);
+			}
+		}
+	}
+}
+
+PlaneBuffers::~PlaneBuffers()
+{
+	for(vector<char *>::iterator i = _planes.begin(); i != _planes.end(); ++i)
+		free(*i);
+}
+
+Slice
+PlaneBuffers::slice(int c) const
+{
+	const size_t colbytes = (_chans[c].type == Imf::HALF ? sizeof(half) : sizeof(float));
+	const size_t rowbytes = colbytes * _width;
+
+	char *origin = _planes[c] - (_dw.min.y * rowbytes) - (_dw.min.x * colbytes);
+
+	return Slice(_chans[c].type, origin, colbytes, rowbytes);
+}
+
+
+#pragma mark-
+
+
+typedef enum {
+	CASE_AOV = 0,
+	CASE_MULTIPART,
+	CASE_TILED,
+	CASE_UINT,
+	CASE_YCC,
+	NUM_CASES
+} BenchCase;
+
+static const char *
+CaseName(BenchCase c)
+{
+	switch(c)
+	{
+		case CASE_AOV:			return "aov";
+		case CASE_MULTIPART:	return "multipart";
+		case CASE_TILED:		return "tiled";
+		case CASE_UINT:			return "uint";
+		case CASE_YCC:			return "ycc";
+		default:				return "";
+	}
+}
+
+static const char *
+CompressionName(Compression compression)
+{
+	switch(compression)
+	{
+		case NO_COMPRESSION:	return "none";
+		case RLE_COMPRESSION:	return "rle";
+		case ZIPS_COMPRESSION:	return "zips";
+		case ZIP_COMPRESSION:	return "zip";
+		case PIZ_COMPRESSION:	return "piz";
+		case PXR24_COMPRESSION:	return "pxr24";
+		case B44_COMPRESSION:	return "b44";
+		case B44A_COMPRESSION:	return "b44a";
+		case DWAA_COMPRESSION:	return "dwaa";
+		case DWAB_COMPRESSION:	return "dwab";
+		default:				return "";
+	}
+}
+
+
+typedef struct BenchOptions {
+	int width;
+	int height;
+	int aov_layers;
+	int iterations;
+	vector<BenchCase> cases;
+	vector<Compression> compressions;
+	vector<int> threads;
+	bool half_storage;
+
+	BenchOptions() : width(1920), height(1080), aov_layers(16), iterations(3), half_storage(false) {}
+} BenchOptions;
+
+
+typedef struct PhaseResult {
+	double seconds;
+	Int64 peak_rss;
+
+	PhaseResult() : seconds(numeric_limits<double>::max()), peak_rss(0) {}
+
+	void add(double s, Int64 rss) { seconds = MIN(seconds, s); peak_rss = MAX(peak_rss, rss); }
+} PhaseResult;
+
+
+static vector<BenchChannel>
+CaseChannels(BenchCase c, const BenchOptions &options)
+{
+	if(c == CASE_YCC)
+	{
+		vector<BenchChannel> chans;
+
+		chans.push_back( BenchChannel("R", Imf::HALF) );
+		chans.push_back( BenchChannel("G", Imf::HALF) );
+		chans.push_back( BenchChannel("B", Imf::HALF) );
+		chans.push_back( BenchChannel("A", Imf::HALF, true) );
+
+		return chans;
+	}
+	else
+		return AOVChannels(options.aov_layers, c == CASE_UINT);
+}
+
+
+// writes the case's file, timing it if ProEXRdoc is the one doing the writing
+static bool
+WriteCase(BenchCase c, const BenchOptions &options, Compression compression, MemoryOStream &os)
+{
+	const vector<BenchChannel> chans = CaseChannels(c, options);
+
+	if(c == CASE_AOV || c == CASE_UINT || c == CASE_YCC)
+	{
+		Header header(options.width, options.height);
+
+		header.compression() = compression;
+
+		auto_ptr<ProEXRdoc_write_base> doc;
+
+		if(c == CASE_YCC)
+			doc.reset( new ProEXRdoc_writeRGBA(os, header, WRITE_YCA) );
+		else
+			doc.reset( new ProEXRdoc_write(os, header) );
+
+		for(int i=0; i < chans.size(); i++)
+		{
+			ProEXRchannel *chan = new ProEXRchannel(chans[i].name, chans[i].type);
+
+			doc->addChannel(chan);
+
+			FillChannel(*chan, i, chans[i].alpha);
+		}
+
+		doc->writeFile();
+
+		return true;
+	}
+	else if(c == CASE_MULTIPART)
+	{
+		// RGBA in the first part, one part per AOV
+		vector<Header> headers;
+		vector<vector<int> > part_chans;
+
+		for(int i=0; i < chans.size(); i++)
+		{
+			ProEXRchannel temp(chans[i].name);
+
+			const string part_name = (temp.channelType() == CHANNEL_LAYER ? temp.layerName() : string("rgba"));
+
+			if(headers.empty() || headers.back().name() != part_name)
+			{
+				Header header(options.width, options.height);
+
+				header.compression() = compression;
+				header.setName(part_name);
+				header.setType(SCANLINEIMAGE);
+
+				headers.push_back(header);
+				part_chans.push_back( vector<int>() );
+			}
+
+			headers.back().channels().insert(headers.size() == 1 ? temp.name() : temp.channelName(), Channel(chans[i].type));
+			part_chans.back().push_back(i);
+		}
+
+		const Box2i dw = headers[0].dataWindow();
+
+		PlaneBuffers planes(chans, dw);
+
+		MultiPartOutputFile file(os, &headers[0], headers.size());
+
+		for(int n=0; n < headers.size(); n++)
+		{
+			FrameBuffer frameBuffer;
+
+			for(int i=0; i < part_chans[n].size(); i++)
+			{
+				const int ch = part_chans[n][i];
+
+				ProEXRchannel temp(chans[ch].name);
+
+				frameBuffer.insert(n == 0 ? temp.name() : temp.channelName(), planes.slice(ch));
+			}
+
+			OutputPart part(file, n);
+
+			part.setFrameBuffer(frameBuffer);
+			part.writePixels(options.height);
+		}
+
+		return false;
+	}
+	else
+	{
+		assert(c == CASE_TILED);
+
+		// data window hangs off the display window, and not on a tile boundary
+		const Box2i displayWindow(V2i(0, 0), V2i(options.width - 1, options.height - 1));
+		const Box2i dataWindow(V2i(-37, 53), V2i(options.width - 38, options.height + 52));
+
+		Header header(displayWindow, dataWindow);
+
+		header.compression() = compression;
+		header.setTileDescription( TileDescription(64, 64, ONE_LEVEL) );
+
+		FrameBuffer frameBuffer;
+
+		PlaneBuffers planes(chans, dataWindow);
+
+		for(int i=0; i < chans.size(); i++)
+		{
+			header.channels().insert(chans[i].name, Channel(chans[i].type));
+
+			frameBuffer.insert(chans[i].name, planes.slice(i));
+		}
+
+		TiledOutputFile file(os, header);
+
+		file.setFrameBuffer(frameBuffer);
+		file.writeTiles(0, file.numXTiles() - 1, 0, file.numYTiles() - 1);
+
+		return false;
+	}
+}
+
+
+static void
+PostProcess(ProEXRdoc_read &doc)
+{
+	// the round trip the plug-ins make: unmult for editing, then back again
+	ProEXRchannel *alpha = doc.getAlphaChannel();
+
+	for(vector<ProEXRlayer *>::iterator i = doc.layers().begin(); i != doc.layers().end(); ++i)
+		(*i)->unMult(alpha);
+
+	for(vector<ProEXRlayer *>::iterator i = doc.layers().begin(); i != doc.layers().end(); ++i)
+		(*i)->premultiply(alpha);
+
+	for(vector<ProEXRchannel *>::iterator i = doc.channels().begin(); i != doc.channels().end(); ++i)
+	{
+		ProEXRchannel *chan = *i;
+
+		chan->killNaN();
+
+		if(chan->channelTag() == CHAN_A)
+			chan->alphaClip();
+	}
+}
+
+
+static void
+Report(BenchCase c, Compression compression, int threads, const char *phase,
+		const PhaseResult &result, Int64 pixel_bytes, Int64 pixels, Int64 file_bytes)
+{
+	cout << left << setw(10) << CaseName(c)
+			<< setw(7) << CompressionName(compression)
+			<< right << setw(4) << threads << "  "
+			<< left << setw(6) << phase
+			<< right << fixed << setprecision(4) << setw(9) << result.seconds
+			<< setprecision(1) << setw(10) << ((double)pixel_bytes / (1024.0 * 1024.0) / result.seconds)
+			<< setw(10) << ((double)pixels / 1000000.0 / result.seconds)
+			<< setw(10) << ((double)result.peak_rss / (1024.0 * 1024.0))
+			<< setw(10) << ((double)file_bytes / (1024.0 * 1024.0))
+			<< endl;
+}
+
+
+static void
+RunCase(BenchCase c, Compression compression, int threads, const BenchOptions &options)
+{
+	setGlobalThreadCount(threads);
+
+	const vector<BenchChannel> chans = CaseChannels(c, options);
+
+	const Int64 pixels = (Int64)options.width * (Int64)options.height;
+	const Int64 pixel_bytes = PixelBytes(chans, options.width, options.height);
+
+	PhaseResult write_result, read_result, post_result;
+
+	Int64 file_bytes = 0;
+
+	bool timed_write = false;
+
+	for(int i=0; i < options.iterations; i++)
+	{
+		MemoryOStream os;
+
+		ResetPeakRSS();
+
+		double start = Now();
+
+		timed_write = WriteCase(c, options, compression, os);
+
+		write_result.add(Now() - start, PeakRSS());
+
+		file_bytes = os.data().size();
+
+
+		MemoryIStream is( os.data() );
+
+		ResetPeakRSS();
+
+		start = Now();
+
+		ProEXRdoc_read doc(is);
+
+		doc.setHalfStorage(options.half_storage);
+
+		doc.loadFromFile();
+
+		read_result.add(Now() - start, PeakRSS());
+
+		if( !doc.loaded() )
+			throw BaseExc("Couldn't load benchmark file.");
+
+
+		ResetPeakRSS();
+
+		start = Now();
+
+		PostProcess(doc);
+
+		post_result.add(Now() - start, PeakRSS());
+	}
+
+	if(timed_write)
+		Report(c, compression, threads, "write", write_result, pixel_bytes, pixels, file_bytes);
+
+	Report(c, compression, threads, "read", read_result, pixel_bytes, pixels, file_bytes);
+	Report(c, compression, threads, "post", post_result, pixel_bytes, pixels, file_bytes);
+}
+
+
+static void
+Usage(const char *prog)
+{
+	cerr << "usage: " << prog << " [options]" << endl;
+	cerr << endl;
+	cerr << "  --size <w>x<h>            image size (default 1920x1080)" << endl;
+	cerr << "  --aovs <n>                AOV layers, 3 channels each (default 16)" << endl;
+	cerr << "  --iterations <n>          best of n runs (default 3)" << endl;
+	cerr << "  --case <name>             aov, multipart, tiled, uint, ycc (repeatable, default all)" << endl;
+	cerr << "  --compression <type>      none, rle, zips, zip, piz, pxr24, b44, b44a, dwaa, dwab (repeatable)" << endl;
+	cerr << "  --threads <n>             thread count to test (repeatable, default 1 and all CPUs)" << endl;
+	cerr << "  --storage <type>          float or half, how HALF channels are kept in memory (default float)" << endl;
+}
+
+
+static bool
+ParseArgs(int argc, char *argv[], BenchOptions &options)
+{
+	for(int i=1; i < argc; i++)
+	{
+		const string arg = argv[i];
+
+		if(i + 1 >= argc)
+			return false;
+
+		const string val = argv[++i];
+
+		if(arg == "--size")
+		{
+			if(sscanf(val.c_str(), "%dx%d", &options.width, &options.height) != 2 || options.width < 1 || options.height < 1)
+				return false;
+		}
+		else if(arg == "--aovs")
+		{
+			options.aov_layers = MAX(atoi(val.c_str()), 0);
+		}
+		else if(arg == "--iterations")
+		{
+			options.iterations = MAX(atoi(val.c_str()), 1);
+		}
+		else if(arg == "--case")
+		{
+			bool found = false;
+
+			for(int c=0; c < NUM_CASES && !found; c++)
+			{
+				if(val == CaseName((BenchCase)c))
+				{
+					options.cases.push_back((BenchCase)c);
+					found = true;
+				}
+			}
+
+			if(!found)
+				return false;
+		}
+		else if(arg == "--compression")
+		{
+			bool found = false;
+
+			for(int c=0; c < NUM_COMPRESSION_METHODS && !found; c++)
+			{
+				if(val == CompressionName((Compression)c))
+				{
+					options.compressions.push_back((Compression)c);
+					found = true;
+				}
+			}
+
+			if(!found)
+				return false;
+		}
+		else if(arg == "--threads")
+		{
+			options.threads.push_back( MAX(atoi(val.c_str()), 0) );
+		}
+		else if(arg == "--storage")
+		{
+			if(val == "float")
+				options.half_storage = false;
+			else if(val == "half")
+				options.half_storage = true;
+			else
+				return false;
+		}
+		else
+			return false;
+	}
+
+	if(options.cases.empty())
+	{
+		for(int c=0; c < NUM_CASES; c++)
+			options.cases.push_back((BenchCase)c);
+	}
+
+	if(options.compressions.empty())
+	{
+		options.compressions.push_back(NO_COMPRESSION);
+		options.compressions.push_back(ZIP_COMPRESSION);
+		options.compressions.push_back(PIZ_COMPRESSION);
+		options.compressions.push_back(DWAA_COMPRESSION);
+	}
+
+	if(options.threads.empty())
+	{
+		options.threads.push_back(1);
+
+		if(NumCPUs() > 1)
+			options.threads.push_back( NumCPUs() );
+	}
+
+	return true;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	BenchOptions options;
+
+	if( !ParseArgs(argc, argv, options) )
+	{
+		Usage("proexr-bench");
+
+		return 2;
+	}
+
+	staticInitialize();
+
+	cout << options.width << "x" << options.height << ", " << options.aov_layers << " AOV layers, best of " << options.iterations << ", " << (options.half_storage ? "half" : "float") << " storage, " << PixelKernelsName() << " kernels" << endl;
+	cout << endl;
+	cout << "case      comp   thr  phase   seconds      MB/s   Mpix/s   peak MB   file MB" << endl;
+
+	try{
+		for(vector<BenchCase>::const_iterator c = options.cases.begin(); c != options.cases.end(); ++c)
+			for(vector<Compression>::const_iterator z = options.compressions.begin(); z != options.compressions.end(); ++z)
+				for(vector<int>::const_iterator t = options.threads.begin(); t != options.threads.end(); ++t)
+				{
+					RunCase(*c, *z, *t, options);
+				}
+	}
+	catch(std::exception &e)
+	{
+		cerr << "proexr-bench: " << e.what() << endl;
+
+		return 1;
+	}
+
+	return 0;
+}
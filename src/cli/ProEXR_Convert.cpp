@@ -0,0 +1,1324 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+// proexr-convert
+//
+// Command-line converter built on the same ProEXRdoc core as the plug-ins,
+// for re-layering, recompressing, and splitting or merging multi-part
+// EXR and VRimg files on machines without a host app.
+
+#include "ProEXRdoc.h"
+#include "ProEXR_PixelKernels.h"
+#include "ProEXR_PlanePool.h"
+#include "ProEXR_MappedIStream.h"
+#include "ProEXR_ReadAheadIStream.h"
+#include "ProEXR_WriteBehindOStream.h"
+
+#include "VRimgInputFile.h"
+
+#include <ImfStdIO.h>
+#include <ImfMultiPartOutputFile.h>
+#include <ImfOutputPart.h>
+#include <ImfPartType.h>
+#include <ImfThreading.h>
+#include <ImfArray.h>
+
+#include <IlmThread.h>
+#include <IlmThreadPool.h>
+#include <IlmThreadMutex.h>
+
+#include <Iex.h>
+
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <set>
+#include <memory>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include <assert.h>
+
+using namespace Imf;
+using namespace Imath;
+using namespace Iex;
+using namespace IlmThread;
+using namespace std;
+
+
+// freed channel buffers we'll keep around for the next frame
+static const size_t kPlanePoolBytes = ((size_t)1 << 30);
+
+// --read-ahead comes in blocks this big
+static const size_t kReadAheadBlockBytes = (4 * 1024 * 1024);
+
+
+typedef enum {
+	PARTS_SINGLE = 0,	// merge everything into one part
+	PARTS_LAYERS,		// one part per layer
+	PARTS_KEEP			// same parts as the input file
+} PartMode;
+
+typedef struct ConvertOptions {
+	bool			set_compression;
+	Compression		compression;
+	bool			set_pixel_type;
+	Imf::PixelType	pixel_type;
+	PartMode		parts;
+	bool			separate_files;
+	bool			clip_alpha;
+	bool			stats;
+	int				read_ahead; // MB, 0 to map the file instead
+	bool			crop;
+	Box2i			crop_window;
+	int				proxy_scale;
+	int				tile_size;
+	int				mip_levels;
+	vector<string>	layers;
+	map<string, string> renames;
+	int				threads;
+	int				jobs;
+	string			output;
+
+	ConvertOptions() :
+		set_compression(false),
+		compression(ZIP_COMPRESSION),
+		set_pixel_type(false),
+		pixel_type(Imf::HALF),
+		parts(PARTS_SINGLE),
+		separate_files(false),
+		clip_alpha(false),
+		stats(false),
+		read_ahead(0),
+		crop(false),
+		proxy_scale(1),
+		tile_size(0),
+		mip_levels(0),
+		threads(0),
+		jobs(1)
+	{}
+} ConvertOptions;
+
+
+static const char *
+CompressionName(Compression compression)
+{
+	switch(compression)
+	{
+		case NO_COMPRESSION:	return "none";
+		case RLE_COMPRESSION:	return "rle";
+		case ZIPS_COMPRESSION:	return "zips";
+		case ZIP_COMPRESSION:	return "zip";
+		case PIZ_COMPRESSION:	return "piz";
+		case PXR24_COMPRESSION:	return "pxr24";
+		case B44_COMPRESSION:	return "b44";
+		case B44A_COMPRESSION:	return "b44a";
+		case DWAA_COMPRESSION:	return "dwaa";
+		case DWAB_COMPRESSION:	return "dwab";
+		default:				return NULL;
+	}
+}
+
+static bool
+ParseCompression(const string &str, Compression &compression)
+{
+	for(int i=0; i < NUM_COMPRESSION_METHODS; i++)
+	{
+		const char *name = CompressionName((Compression)i);
+
+		if(name && str == name)
+		{
+			compression = (Compression)i;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static void
+Usage(const char *prog)
+{
+	cerr << "usage: " << prog << " [options] input [input ...] output" << endl;
+	cerr << endl;
+	cerr << "Converts OpenEXR and VRimg files.  With more than one input, output must be a directory." << endl;
+	cerr << endl;
+	cerr << "  -c, --compression <type>   none, rle, zips, zip, piz, pxr24, b44, b44a, dwaa, dwab" << endl;
+	cerr << "      --half                 write float channels as half" << endl;
+	cerr << "      --float                write half channels as float" << endl;
+	cerr << "      --parts <mode>         single (merge parts), layers (one part per layer), keep" << endl;
+	cerr << "      --split-files          write each layer to its own file" << endl;
+	cerr << "  -l, --layer <name>         only convert this layer (repeatable, RGBA for the main channels)" << endl;
+	cerr << "  -r, --rename <old>=<new>   rename a layer or channel (repeatable)" << endl;
+	cerr << "      --clip-alpha           clip alpha channels to 0-1" << endl;
+	cerr << "      --stats                print each channel's min, max, mean and NaN/inf/negative counts (OpenEXR input)" << endl;
+	cerr << "      --read-ahead <MB>      read this far ahead on a thread instead of mapping the file (network storage)" << endl;
+	cerr << "      --crop <x1>,<y1>,<x2>,<y2>  only read and write this part of the data window" << endl;
+	cerr << "      --proxy <n>            write at 1/n size, using mipmap/ripmap levels if there are any" << endl;
+	cerr << "      --tiles <n>            write n x n tiles instead of scanlines (single part only)" << endl;
+	cerr << "      --mipmap <round>       with --tiles, add mipmap levels rounding down or up" << endl;
+	cerr << "  -t, --threads <n>          decode/encode threads per file (default: all CPUs)" << endl;
+	cerr << "  -j, --jobs <n>             files to convert at the same time (default: 1)" << endl;
+}
+
+
+static int
+NumCPUs()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (cpus > 0 ? cpus : 1);
+#else
+	return 1;
+#endif
+}
+
+
+static bool
+IsDirectory(const string &path)
+{
+	struct stat st;
+
+	return (stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFDIR));
+}
+
+
+static Int64
+FileSize(const string &path)
+{
+	struct stat st;
+
+	if(stat(path.c_str(), &st) != 0)
+		throwErrnoExc("Can't get the size of " + path + " (%T).", errno);
+
+	return st.st_size;
+}
+
+
+static string
+BaseName(const string &path)
+{
+	const string::size_type slash = path.find_last_of("/\\");
+
+	return (slash == string::npos ? path : path.substr(slash + 1));
+}
+
+
+static string
+StripExtension(const string &path, string &extension)
+{
+	const string::size_type dot = path.find_last_of('.');
+	const string::size_type slash = path.find_last_of("/\\");
+
+	if(dot != string::npos && (slash == string::npos || dot > slash))
+	{
+		extension = path.substr(dot);
+
+		return path.substr(0, dot);
+	}
+	else
+	{
+		extension = "";
+
+		return path;
+	}
+}
+
+
+static bool
+IsVRimg(const string &path)
+{
+	string extension;
+	StripExtension(path, extension);
+
+	for(string::iterator i = extension.begin(); i != extension.end(); ++i)
+		*i = tolower(*i);
+
+	return (extension == ".vrimg");
+}
+
+
+#pragma mark-
+
+
+class ProEXRchannel_convert : public ProEXRchannel
+{
+  public:
+	ProEXRchannel_convert(string name, Imf::PixelType pixelType=Imf::HALF) : ProEXRchannel(name, pixelType), _part(0) {}
+	virtual ~ProEXRchannel_convert() {}
+
+	// copy samples (half, float or uint) from somewhere else, converting between half and float if need be
+	void loadFromBuffer(const char *buf, Imf::PixelType type, size_t colbytes, size_t rowbytes);
+
+	int part() const { return _part; }
+	void setPart(int part) { _part = part; }
+
+	const string & partName() const { return _partName; }
+	void setPartName(const string &partName) { _partName = partName; }
+
+  private:
+	int _part;
+	string _partName;
+};
+
+// copy samples into desc's rows, converting between half and float if need be
+static void
+CopyPixels(const char *buf, Imf::PixelType type, size_t colbytes, size_t rowbytes, const ProEXRbuffer &desc)
+{
+	const bool in_half = (type == Imf::HALF);
+	const bool out_half = (desc.type == Imf::HALF);
+
+	Array<float> float_row(desc.width);
+
+	const char *in_row = buf;
+	char *out_row = (char *)desc.buf;
+
+	for(int y=0; y < desc.height; y++)
+	{
+		const char *in_pix = in_row;
+
+		if(in_half == out_half)
+		{
+			if(out_half)
+			{
+				half *out_pix = (half *)out_row;
+
+				for(int x=0; x < desc.width; x++)
+				{
+					*out_pix++ = *(const half *)in_pix;
+
+					in_pix += colbytes;
+				}
+			}
+			else
+			{
+				unsigned int *out_pix = (unsigned int *)out_row;
+
+				for(int x=0; x < desc.width; x++)
+				{
+					*out_pix++ = *(const unsigned int *)in_pix;
+
+					in_pix += colbytes;
+				}
+			}
+		}
+		else if(in_half)
+		{
+			float *out_pix = (float *)out_row;
+
+			if(colbytes == sizeof(half))
+			{
+				HalfToFloatRow((const half *)in_pix, out_pix, desc.width);
+			}
+			else
+			{
+				for(int x=0; x < desc.width; x++)
+				{
+					*out_pix++ = *(const half *)in_pix;
+
+					in_pix += colbytes;
+				}
+			}
+		}
+		else
+		{
+			assert(type == Imf::FLOAT);
+
+			for(int x=0; x < desc.width; x++)
+			{
+				float_row[x] = *(const float *)in_pix;
+
+				in_pix += colbytes;
+			}
+
+			FloatToHalfRow(float_row, (half *)out_row, desc.width);
+		}
+
+		in_row += rowbytes;
+		out_row += desc.rowbytes;
+	}
+}
+
+void
+ProEXRchannel_convert::loadFromBuffer(const char *buf, Imf::PixelType type, size_t colbytes, size_t rowbytes)
+{
+	allocateBuffers(false, false); // we're about to write every pixel
+
+	ProEXRbuffer desc = getBufferDesc(false);
+
+	if(desc.buf == NULL)
+		throw BaseExc("buffer.buf is NULL.");
+
+	CopyPixels(buf, type, colbytes, rowbytes, desc);
+
+	setLoaded(true);
+}
+
+
+// writes the channels into a multi-part file, each channel already assigned to a part
+class ProEXRdoc_writeParts : public ProEXRdoc_write_base
+{
+  public:
+	ProEXRdoc_writeParts(OStream &os, Header &header) : ProEXRdoc_write_base(os, header) {}
+	virtual ~ProEXRdoc_writeParts() {}
+
+	virtual void writeFile();
+};
+
+void
+ProEXRdoc_writeParts::writeFile()
+{
+	vector<ProEXRchannel *> &chans = channels();
+
+	// parts can have gaps after filtering, so number them in order
+	map<int, int> part_numbers;
+
+	for(vector<ProEXRchannel *>::iterator i = chans.begin(); i != chans.end(); ++i)
+	{
+		ProEXRchannel_convert &chan = dynamic_cast<ProEXRchannel_convert &>( **i );
+
+		if( chan.loaded() )
+			part_numbers[chan.part()] = 0;
+	}
+
+	if(part_numbers.empty())
+		throw BaseExc("No channels to write.");
+
+	int num_parts = 0;
+
+	for(map<int, int>::iterator i = part_numbers.begin(); i != part_numbers.end(); ++i)
+		i->second = num_parts++;
+
+	vector<Header> headers(num_parts, header());
+	vector<FrameBuffer> frameBuffers(num_parts);
+	vector<string> part_names(num_parts);
+
+	const Box2i &dw = header().dataWindow();
+
+	for(vector<ProEXRchannel *>::iterator i = chans.begin(); i != chans.end(); ++i)
+	{
+		ProEXRchannel_convert &chan = dynamic_cast<ProEXRchannel_convert &>( **i );
+
+		if( !chan.loaded() )
+			continue;
+
+		const int n = part_numbers[chan.part()];
+
+		if(part_names[n].empty())
+			part_names[n] = chan.partName();
+
+		// the first part keeps full channel names, the rest drop their part prefix
+		// so that HybridInputFile will give us the same names back
+		string part_chan_name = chan.name();
+
+		const string prefix = part_names[n] + ".";
+
+		if(n > 0 && part_chan_name.size() > prefix.size() && part_chan_name.compare(0, prefix.size(), prefix) == 0)
+			part_chan_name = part_chan_name.substr(prefix.size());
+
+		headers[n].channels().insert(part_chan_name, chan.pixelType());
+
+		ProEXRbuffer buffer = chan.getBufferDesc(chan.pixelType() == Imf::HALF);
+
+		if(buffer.buf == NULL)
+			throw BaseExc("buffer.buf is NULL.");
+
+		char *exr_origin = (char *)buffer.buf - (dw.min.y * buffer.rowbytes) - (dw.min.x * buffer.colbytes);
+
+		frameBuffers[n].insert(part_chan_name,
+					Slice(chan.pixelType(), exr_origin, buffer.colbytes, buffer.rowbytes) );
+	}
+
+	// part names have to be unique
+	set<string> used_names;
+
+	for(int n=0; n < num_parts; n++)
+	{
+		const string base_name = (part_names[n].empty() ? string("rgba") : part_names[n]);
+
+		string part_name = base_name;
+
+		for(int suffix = 2; used_names.find(part_name) != used_names.end(); suffix++)
+		{
+			ostringstream num;
+			num << base_name << suffix;
+			part_name = num.str();
+		}
+
+		used_names.insert(part_name);
+
+		headers[n].setName(part_name);
+		headers[n].setType(SCANLINEIMAGE);
+	}
+
+	MultiPartOutputFile file(stream(), &headers[0], num_parts);
+
+	const int dw_height = (dw.max.y - dw.min.y) + 1;
+
+	for(int n=0; n < num_parts; n++)
+	{
+		OutputPart part(file, n);
+
+		part.setFrameBuffer(frameBuffers[n]);
+
+		part.writePixels(dw_height);
+	}
+}
+
+
+#pragma mark-
+
+
+// a channel we're going to write, and where its pixels come from
+typedef struct SourceChannel {
+	string name;
+	Imf::PixelType type;
+	int part;
+	string partName;
+
+	ProEXRchannel *exr_channel; // when reading EXR
+	const char *buf; // when reading VRimg
+	size_t colbytes;
+	size_t rowbytes;
+
+	SourceChannel() : type(Imf::HALF), part(0), exr_channel(NULL), buf(NULL), colbytes(0), rowbytes(0) {}
+} SourceChannel;
+
+
+static string
+LayerKey(const ProEXRchannel &chan)
+{
+	const ChannelType type = chan.channelType();
+
+	return (type == CHANNEL_LAYER ? chan.layerName() :
+			type == CHANNEL_SINGLE ? chan.name() :
+			string("RGBA"));
+}
+
+
+static string
+RenameChannel(const string &name, const map<string, string> &renames)
+{
+	if(renames.empty())
+		return name;
+
+	map<string, string>::const_iterator exact = renames.find(name);
+
+	if(exact != renames.end())
+		return exact->second;
+
+	ProEXRchannel temp(name);
+
+	if(temp.channelType() == CHANNEL_LAYER)
+	{
+		map<string, string>::const_iterator layer = renames.find( temp.layerName() );
+
+		if(layer != renames.end())
+			return layer->second + "." + temp.channelName();
+	}
+
+	return name;
+}
+
+
+static void
+WriteChannels(OStream &os, Header &header, const vector<SourceChannel> &sources, const ConvertOptions &options)
+{
+	auto_ptr<ProEXRdoc_write_base> doc;
+
+	if(options.tile_size > 0)
+	{
+		header.setTileDescription( TileDescription(options.tile_size, options.tile_size,
+										(options.mip_levels ? MIPMAP_LEVELS : ONE_LEVEL),
+										(options.mip_levels ? (LevelRoundingMode)(options.mip_levels - 1) : ROUND_DOWN)) );
+	}
+
+	if(options.parts == PARTS_SINGLE)
+		doc.reset( new ProEXRdoc_write(os, header) );
+	else
+		doc.reset( new ProEXRdoc_writeParts(os, header) );
+
+	doc->setHalfStorage(true);
+
+	// a single scanline part can be compressed block by block while
+	// we're still copying, instead of making a whole copy of the file first
+	const bool stream = (options.parts == PARTS_SINGLE && !header.hasTileDescription());
+
+	vector<ProEXRchannel *> out_chans;
+
+	map<string, int> layer_parts;
+
+	for(vector<SourceChannel>::const_iterator i = sources.begin(); i != sources.end(); ++i)
+	{
+		const SourceChannel &source = *i;
+
+		Imf::PixelType pixelType = source.type;
+
+		if(options.set_pixel_type && pixelType != Imf::UINT)
+			pixelType = options.pixel_type;
+
+		ProEXRchannel_convert *chan = new ProEXRchannel_convert(source.name, pixelType);
+
+		doc->addChannel(chan);
+
+		if(options.parts == PARTS_KEEP)
+		{
+			chan->setPart(source.part);
+			chan->setPartName(source.partName);
+		}
+		else if(options.parts == PARTS_LAYERS)
+		{
+			// reserved and single channels all go in the first part
+			if(chan->channelType() == CHANNEL_LAYER)
+			{
+				const string part_name = chan->layerName();
+
+				if(layer_parts.find(part_name) == layer_parts.end())
+				{
+					const int next_part = layer_parts.size() + 1;
+
+					layer_parts[part_name] = next_part;
+				}
+
+				chan->setPart( layer_parts[part_name] );
+				chan->setPartName(part_name);
+			}
+		}
+
+		out_chans.push_back(chan);
+
+		if(stream)
+			continue;
+
+		if(source.exr_channel)
+		{
+			ProEXRbuffer desc = source.exr_channel->getBufferDesc(false);
+
+			chan->loadFromBuffer((const char *)desc.buf, desc.type, desc.colbytes, desc.rowbytes);
+
+			source.exr_channel->freeBuffers(); // done with it
+		}
+		else
+		{
+			assert(source.buf != NULL);
+
+			chan->loadFromBuffer(source.buf, source.type, source.colbytes, source.rowbytes);
+		}
+	}
+
+	if(!stream)
+	{
+		doc->writeFile();
+
+		return;
+	}
+
+	for(vector<ProEXRchannel *>::const_iterator i = out_chans.begin(); i != out_chans.end(); ++i)
+		header.channels().insert((*i)->name(), (*i)->pixelType());
+
+	ProEXRstreamWriter writer(os, header);
+
+	const Box2i &dw = header.dataWindow();
+
+	for(int n=0; n < writer.blocks(); n++)
+	{
+		const int block = writer.orderedBlock(n);
+
+		const Box2i blockW = writer.blockWindow(block);
+
+		for(int c=0; c < sources.size(); c++)
+		{
+			const SourceChannel &source = sources[c];
+			const string &name = out_chans[c]->name();
+
+			const char *buf = source.buf;
+			Imf::PixelType type = source.type;
+			size_t colbytes = source.colbytes;
+			size_t rowbytes = source.rowbytes;
+
+			if(source.exr_channel)
+			{
+				ProEXRbuffer desc = source.exr_channel->getBufferDesc(false);
+
+				buf = (const char *)desc.buf;
+				type = desc.type;
+				colbytes = desc.colbytes;
+				rowbytes = desc.rowbytes;
+			}
+
+			assert(buf != NULL);
+
+			CopyPixels(buf + (rowbytes * (blockW.min.y - dw.min.y)), type, colbytes, rowbytes, writer.channelBuffer(block, name));
+
+			writer.channelReady(block, name);
+		}
+	}
+
+	writer.finish();
+
+	for(vector<SourceChannel>::const_iterator i = sources.begin(); i != sources.end(); ++i)
+	{
+		if(i->exr_channel)
+			i->exr_channel->freeBuffers();
+	}
+}
+
+
+static void
+WriteOutput(const string &out_path, Header &header, const vector<SourceChannel> &sources, const ConvertOptions &options)
+{
+	// filter and rename
+	vector<SourceChannel> channels;
+
+	for(vector<SourceChannel>::const_iterator i = sources.begin(); i != sources.end(); ++i)
+	{
+		bool keep = options.layers.empty();
+
+		if(!keep)
+		{
+			ProEXRchannel temp(i->name);
+
+			const string key = LayerKey(temp);
+
+			for(vector<string>::const_iterator j = options.layers.begin(); j != options.layers.end() && !keep; ++j)
+				keep = (*j == key || *j == i->name);
+		}
+
+		if(keep)
+		{
+			SourceChannel chan = *i;
+
+			chan.name = RenameChannel(chan.name, options.renames);
+
+			channels.push_back(chan);
+		}
+	}
+
+	if(channels.empty())
+		throw ArgExc("No channels selected.");
+
+	if(options.separate_files)
+	{
+		// one file per layer, named like the Photoshop plug-in does it
+		vector<string> keys;
+		map<string, vector<SourceChannel> > files;
+
+		for(vector<SourceChannel>::const_iterator i = channels.begin(); i != channels.end(); ++i)
+		{
+			ProEXRchannel temp(i->name);
+
+			const string key = LayerKey(temp);
+
+			if(files.find(key) == files.end())
+				keys.push_back(key);
+
+			files[key].push_back(*i);
+		}
+
+		string extension;
+		const string path_base = StripExtension(out_path, extension);
+
+		ConvertOptions file_options = options;
+		file_options.parts = PARTS_SINGLE;
+
+		for(vector<string>::const_iterator i = keys.begin(); i != keys.end(); ++i)
+		{
+			const string path = path_base + "_" + *i + extension;
+
+			Header layer_header = header;
+
+			StdOFStream file_stream( path.c_str() );
+
+			WriteBehindOStream out_stream(file_stream);
+
+			WriteChannels(out_stream, layer_header, files[*i], file_options);
+
+			out_stream.flush();
+		}
+	}
+	else
+	{
+		// later chunks compress while the earlier ones are being written
+		StdOFStream file_stream( out_path.c_str() );
+
+		WriteBehindOStream out_stream(file_stream);
+
+		WriteChannels(out_stream, header, channels, options);
+
+		out_stream.flush();
+	}
+}
+
+
+static void
+PrintStats(ostream &s, const string &name, const ProEXRstats &stats)
+{
+	s << "  " << name << ": min " << stats.min << ", max " << stats.max << ", mean " << stats.mean;
+	s << ", " << stats.nans << " NaN, " << stats.infs << " inf, " << stats.negatives << " negative" << endl;
+}
+
+static string
+StatsReport(const ProEXRdoc &doc)
+{
+	// gathered while the file was loading, nothing gets read again for this
+	ostringstream s;
+
+	for(vector<ProEXRchannel *>::const_iterator i = doc.channels().begin(); i != doc.channels().end(); ++i)
+	{
+		if( (*i)->stats().valid )
+			PrintStats(s, (*i)->name(), (*i)->stats());
+	}
+
+	const ProEXRstats all = doc.stats();
+
+	if(all.valid)
+		PrintStats(s, "(all channels)", all);
+
+	return s.str();
+}
+
+
+static void
+ConvertEXR(const string &in_path, const string &out_path, const ConvertOptions &options, string &report)
+{
+	// mapped, so chunks decode straight from the page cache, unless the
+	// file is on a share where waiting on each page fault is the slow part
+	auto_ptr<IStream> file_stream;
+	auto_ptr<IStream> in_stream;
+
+	if(options.read_ahead > 0)
+	{
+		file_stream.reset( new StdIFStream( in_path.c_str() ) );
+
+		const int blocks = MAX(((size_t)options.read_ahead << 20) / kReadAheadBlockBytes, (size_t)2);
+
+		in_stream.reset( new ReadAheadIStream(*file_stream, FileSize(in_path), blocks, kReadAheadBlockBytes) );
+	}
+	else
+		in_stream.reset( new MappedIStream( in_path.c_str() ) );
+
+	ProEXRdoc_read in_doc(*in_stream, options.clip_alpha);
+
+	MappedIStream *mapped_stream = dynamic_cast<MappedIStream *>( in_stream.get() );
+
+	if(mapped_stream)
+		mapped_stream->advise( MappedIStream::accessFor( in_doc.file() ) );
+
+	in_doc.setHalfStorage(true); // nothing here needs float HALF channels
+
+	if(options.crop)
+		in_doc.setReadWindow(options.crop_window);
+
+	if(options.proxy_scale > 1)
+		in_doc.setProxyScale(options.proxy_scale);
+
+	in_doc.loadFromFile();
+
+	if( !in_doc.loaded() )
+		throw BaseExc("Not enough memory to load file.");
+
+	if(options.stats)
+		report = StatsReport(in_doc);
+
+
+	// start with the first part's header, minus the part bookkeeping
+	Header header = in_doc.header(0);
+
+	header.erase("name");
+	header.erase("type");
+	header.erase("chunkCount");
+	header.erase("version");
+	header.erase("tiles");
+
+	header.channels() = ChannelList();
+
+	header.dataWindow() = in_doc.file().proxyWindow();
+	header.displayWindow() = in_doc.file().proxyBox( in_doc.file().displayWindow() );
+
+	if(options.set_compression)
+		header.compression() = options.compression;
+
+
+	vector<SourceChannel> sources;
+
+	for(vector<ProEXRlayer *>::iterator i = in_doc.layers().begin(); i != in_doc.layers().end(); ++i)
+	{
+		ProEXRlayer_read &layer = dynamic_cast<ProEXRlayer_read &>( **i );
+
+		for(vector<ProEXRchannel *>::iterator j = layer.channels().begin(); j != layer.channels().end(); ++j)
+		{
+			ProEXRchannel *chan = *j;
+
+			SourceChannel source;
+
+			source.name = chan->name();
+			source.type = chan->pixelType();
+			source.exr_channel = chan;
+
+			const int part = in_doc.file().partForChannel( chan->name() );
+
+			if(part >= 0)
+			{
+				source.part = part;
+
+				if( in_doc.header(part).hasName() )
+					source.partName = in_doc.header(part).name();
+			}
+
+			if( layer.loadAsLayer() )
+			{
+				// Y/RY/BY layers get loaded through the RGBA interface, so it's really RGB now
+				const ChanTag tag = chan->channelTag();
+
+				source.name = (tag == CHAN_Y ? "R" : tag == CHAN_RY ? "G" : tag == CHAN_BY ? "B" : chan->name());
+				source.type = Imf::HALF;
+			}
+
+			sources.push_back(source);
+		}
+	}
+
+	WriteOutput(out_path, header, sources, options);
+}
+
+
+static void
+ConvertVRimg(const string &in_path, const string &out_path, const ConvertOptions &options)
+{
+	if(options.proxy_scale > 1)
+		throw ArgExc("--proxy only works with OpenEXR input");
+
+	StdIFStream in_stream( in_path.c_str() );
+
+	VRimg::InputFile in_file(in_stream);
+
+	const VRimg::Header &vr_head = in_file.header();
+
+	const int width = vr_head.width();
+	const int height = vr_head.height();
+
+	Header header(width, height, vr_head.pixelAspectRatio());
+
+	if(options.set_compression)
+		header.compression() = options.compression;
+
+	if(options.crop)
+	{
+		// VRimg has to be read whole, but we can still write just the crop
+		Box2i &dw = header.dataWindow();
+
+		dw.min.x = MAX(dw.min.x, options.crop_window.min.x);
+		dw.min.y = MAX(dw.min.y, options.crop_window.min.y);
+		dw.max.x = MIN(dw.max.x, options.crop_window.max.x);
+		dw.max.y = MIN(dw.max.y, options.crop_window.max.y);
+
+		if( dw.isEmpty() )
+			throw ArgExc("Crop is outside the image");
+	}
+
+	const Box2i &dw = header.dataWindow();
+
+
+	// load each layer into its own interleaved buffer
+	const VRimg::Header::LayerMap &layers = vr_head.layers();
+
+	VRimg::InputFile::BufferMap buffers;
+
+	for(VRimg::Header::LayerMap::const_iterator i = layers.begin(); i != layers.end(); ++i)
+	{
+		const size_t rowbytes = sizeof(float) * i->second.dimensions * width;
+
+		void *buf = malloc(rowbytes * height);
+
+		if(buf == NULL)
+		{
+			for(VRimg::InputFile::BufferMap::iterator j = buffers.begin(); j != buffers.end(); ++j)
+				free(j->second);
+
+			throw bad_alloc();
+		}
+
+		buffers[i->first] = buf;
+	}
+
+	try{
+		in_file.loadFromFile(&buffers);
+
+		vector<SourceChannel> sources;
+
+		for(VRimg::Header::LayerMap::const_iterator i = layers.begin(); i != layers.end(); ++i)
+		{
+			const string &layer_name = i->first;
+			const VRimg::Layer &layer = i->second;
+
+			const size_t colbytes = sizeof(float) * layer.dimensions;
+			const size_t rowbytes = colbytes * width;
+
+			static const char * const rgb_names[] = { "R", "G", "B" };
+			static const char * const xyz_names[] = { "X", "Y", "Z" };
+
+			for(int c=0; c < layer.dimensions; c++)
+			{
+				SourceChannel source;
+
+				if(layer_name == "RGB color" && layer.dimensions == 3)
+					source.name = rgb_names[c];
+				else if(layer_name == "Alpha" && layer.dimensions == 1)
+					source.name = "A";
+				else if(layer.dimensions == 1)
+					source.name = layer_name;
+				else if(layer.dimensions == 2)
+					source.name = layer_name + "." + xyz_names[c];
+				else
+					source.name = layer_name + "." + rgb_names[c];
+
+				source.type = (layer.type == VRimg::INT ? Imf::UINT : Imf::FLOAT);
+				source.buf = (const char *)buffers[layer_name] + (rowbytes * dw.min.y) + (colbytes * dw.min.x) + (c * sizeof(float));
+				source.colbytes = colbytes;
+				source.rowbytes = rowbytes;
+
+				sources.push_back(source);
+			}
+		}
+
+		WriteOutput(out_path, header, sources, options);
+	}
+	catch(...)
+	{
+		for(VRimg::InputFile::BufferMap::iterator j = buffers.begin(); j != buffers.end(); ++j)
+			free(j->second);
+
+		throw;
+	}
+
+	for(VRimg::InputFile::BufferMap::iterator j = buffers.begin(); j != buffers.end(); ++j)
+		free(j->second);
+}
+
+
+static void
+ConvertFile(const string &in_path, const string &out_path, const ConvertOptions &options, string &report)
+{
+	if( IsVRimg(in_path) )
+		ConvertVRimg(in_path, out_path, options);
+	else
+		ConvertEXR(in_path, out_path, options, report);
+}
+
+
+#pragma mark-
+
+
+static Mutex gReportMutex;
+
+class ConvertFileTask : public Task
+{
+  public:
+	ConvertFileTask(TaskGroup *group, const string &in_path, const string &out_path,
+						const ConvertOptions &options, int &errors);
+	virtual ~ConvertFileTask() {}
+
+	virtual void execute();
+
+  private:
+	const string _in_path;
+	const string _out_path;
+	const ConvertOptions &_options;
+	int &_errors;
+};
+
+ConvertFileTask::ConvertFileTask(TaskGroup *group, const string &in_path, const string &out_path,
+									const ConvertOptions &options, int &errors) :
+	Task(group),
+	_in_path(in_path),
+	_out_path(out_path),
+	_options(options),
+	_errors(errors)
+{
+
+}
+
+void
+ConvertFileTask::execute()
+{
+	string error, report;
+
+	try{
+		ConvertFile(_in_path, _out_path, _options, report);
+	}
+	catch(bad_alloc)
+	{
+		error = "out of memory";
+	}
+	catch(std::exception &e)
+	{
+		error = e.what();
+	}
+	catch(...)
+	{
+		error = "unknown error";
+	}
+
+	Lock lock(gReportMutex);
+
+	if(error.empty())
+	{
+		cout << _in_path << " -> " << _out_path << endl;
+
+		cout << report;
+	}
+	else
+	{
+		cerr << "proexr-convert: " << _in_path << ": " << error << endl;
+
+		_errors++;
+	}
+}
+
+
+static bool
+ParseArgs(int argc, char *argv[], ConvertOptions &options, vector<string> &inputs)
+{
+	vector<string> paths;
+
+	for(int i=1; i < argc; i++)
+	{
+		const string arg = argv[i];
+		const bool have_value = (i + 1 < argc);
+
+		if(arg == "-c" || arg == "--compression")
+		{
+			if( !have_value || !ParseCompression(argv[++i], options.compression) )
+				return false;
+
+			options.set_compression = true;
+		}
+		else if(arg == "--half" || arg == "--float")
+		{
+			options.set_pixel_type = true;
+			options.pixel_type = (arg == "--half" ? Imf::HALF : Imf::FLOAT);
+		}
+		else if(arg == "--parts")
+		{
+			if(!have_value)
+				return false;
+
+			const string mode = argv[++i];
+
+			if(mode == "single")		options.parts = PARTS_SINGLE;
+			else if(mode == "layers")	options.parts = PARTS_LAYERS;
+			else if(mode == "keep")		options.parts = PARTS_KEEP;
+			else
+				return false;
+		}
+		else if(arg == "--split-files")
+		{
+			options.separate_files = true;
+		}
+		else if(arg == "-l" || arg == "--layer")
+		{
+			if(!have_value)
+				return false;
+
+			options.layers.push_back(argv[++i]);
+		}
+		else if(arg == "-r" || arg == "--rename")
+		{
+			if(!have_value)
+				return false;
+
+			const string rename = argv[++i];
+			const string::size_type eq = rename.find('=');
+
+			if(eq == string::npos || eq == 0 || eq == rename.size() - 1)
+				return false;
+
+			options.renames[ rename.substr(0, eq) ] = rename.substr(eq + 1);
+		}
+		else if(arg == "--clip-alpha")
+		{
+			options.clip_alpha = true;
+		}
+		else if(arg == "--stats")
+		{
+			options.stats = true;
+		}
+		else if(arg == "--read-ahead")
+		{
+			if(!have_value)
+				return false;
+
+			options.read_ahead = atoi(argv[++i]);
+
+			if(options.read_ahead < 0)
+				return false;
+		}
+		else if(arg == "--crop")
+		{
+			Box2i &crop = options.crop_window;
+
+			if(!have_value || sscanf(argv[++i], "%d,%d,%d,%d", &crop.min.x, &crop.min.y, &crop.max.x, &crop.max.y) != 4 || crop.isEmpty())
+				return false;
+
+			options.crop = true;
+		}
+		else if(arg == "--proxy")
+		{
+			if(!have_value)
+				return false;
+
+			options.proxy_scale = atoi(argv[++i]);
+
+			if(options.proxy_scale < 1)
+				return false;
+		}
+		else if(arg == "--tiles")
+		{
+			if(!have_value)
+				return false;
+
+			options.tile_size = atoi(argv[++i]);
+
+			if(options.tile_size < 1)
+				return false;
+		}
+		else if(arg == "--mipmap")
+		{
+			if(!have_value)
+				return false;
+
+			const string round = argv[++i];
+
+			if(round == "down")		options.mip_levels = ROUND_DOWN + 1;
+			else if(round == "up")	options.mip_levels = ROUND_UP + 1;
+			else
+				return false;
+		}
+		else if(arg == "-t" || arg == "--threads")
+		{
+			if(!have_value)
+				return false;
+
+			options.threads = atoi(argv[++i]);
+		}
+		else if(arg == "-j" || arg == "--jobs")
+		{
+			if(!have_value)
+				return false;
+
+			options.jobs = MAX(atoi(argv[++i]), 1);
+		}
+		else if(arg.size() > 1 && arg[0] == '-')
+		{
+			return false;
+		}
+		else
+			paths.push_back(arg);
+	}
+
+	if(paths.size() < 2)
+		return false;
+
+	if(options.tile_size > 0 && options.parts != PARTS_SINGLE)
+		return false;
+
+	if(options.mip_levels && options.tile_size == 0)
+		return false;
+
+	options.output = paths.back();
+
+	paths.pop_back();
+
+	inputs = paths;
+
+	return true;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	ConvertOptions options;
+	vector<string> inputs;
+
+	if( !ParseArgs(argc, argv, options, inputs) )
+	{
+		Usage("proexr-convert");
+
+		return 2;
+	}
+
+	const bool output_is_dir = IsDirectory(options.output);
+
+	if(inputs.size() > 1 && !output_is_dir)
+	{
+		cerr << "proexr-convert: " << options.output << " is not a directory" << endl;
+
+		return 2;
+	}
+
+	staticInitialize();
+
+	if( supportsThreads() )
+		setGlobalThreadCount(options.threads > 0 ? options.threads : NumCPUs());
+
+	// frames in a sequence are usually all the same size, so hang on to
+	// freed channel buffers for the next one instead of faulting in new pages
+	SetPlanePoolLimit(kPlanePoolBytes);
+
+
+	int errors = 0;
+
+	{
+		// separate pool for whole files, so their pixel tasks can still use the global one
+		ThreadPool file_pool( supportsThreads() ? options.jobs : 0 );
+
+		TaskGroup taskGroup;
+
+		for(vector<string>::const_iterator i = inputs.begin(); i != inputs.end(); ++i)
+		{
+			string out_path = options.output;
+
+			if(output_is_dir)
+			{
+				string extension;
+
+				out_path += "/" + StripExtension(BaseName(*i), extension) + ".exr";
+			}
+
+			file_pool.addTask(new ConvertFileTask(&taskGroup, *i, out_path, options, errors) );
+		}
+	}
+
+	return (errors ? 1 : 0);
+}
@@ -24,21 +24,168 @@
 #include "ImfHybridInputFile.h"
 
 #include "ImfInputPart.h"
+#include "ImfTiledInputPart.h"
 #include "ImfPartType.h"
+#include "ImfArray.h"
+
+#include "half.h"
 
 #include "Iex.h"
 
+#include "IlmThread.h"
+#include "IlmThreadPool.h"
+
+#include <string.h>
+
 
 OPENEXR_IMF_INTERNAL_NAMESPACE_SOURCE_ENTER
 
 
 using namespace std;
+using namespace ILMTHREAD_NAMESPACE;
 using IMATH_NAMESPACE::Box2i;
+using IMATH_NAMESPACE::V2i;
+
+
+// how much to decode at once when we have to crop
+static const size_t kCropStripBytes = (16 * 1024 * 1024);
+
+
+static size_t
+PixelSize(PixelType type)
+{
+	return (type == HALF ? 2 : 4);
+}
+
+
+// proxy pixel p covers file pixels origin + (p - origin) * scale and the
+// (scale - 1) after it
+static int
+ProxyCoord(int x, int origin, int scale)
+{
+	const int d = x - origin;
+	
+	return origin + (d >= 0 ? d / scale : -((scale - 1 - d) / scale));
+}
+
+
+static int
+LevelSize(int size, int level, LevelRoundingMode rounding)
+{
+	const int level_scale = (1 << level);
+	
+	const int level_size = (rounding == ROUND_UP ? (size + level_scale - 1) / level_scale : size / level_scale);
+	
+	return max(level_size, 1);
+}
+
+
+// Which level of a part has the proxy pixels, or -1 if we'll have to filter.
+// The level has to be there, start at the origin, and be exactly the size
+// of the part in proxy pixels (which it isn't with ROUND_DOWN sometimes).
+static int
+ProxyLevel(const Header &head, const V2i &origin, int scale)
+{
+	if(scale == 1)
+		return 0;
+	
+	if( !head.hasTileDescription() )
+		return -1;
+	
+	const TileDescription &tiles = head.tileDescription();
+	
+	if(tiles.mode != MIPMAP_LEVELS && tiles.mode != RIPMAP_LEVELS)
+		return -1;
+	
+	int level = 0;
+	
+	while((1 << level) < scale)
+		level++;
+	
+	if((1 << level) != scale)
+		return -1;
+	
+	const Box2i &dataW = head.dataWindow();
+	
+	if(dataW.min != origin)
+		return -1;
+	
+	const int width = (dataW.max.x - dataW.min.x) + 1;
+	const int height = (dataW.max.y - dataW.min.y) + 1;
+	
+	if(tiles.mode == MIPMAP_LEVELS ? (scale > max(width, height)) : (scale > width || scale > height))
+		return -1;
+	
+	if(LevelSize(width, level, tiles.roundingMode) != (width + scale - 1) / scale ||
+		LevelSize(height, level, tiles.roundingMode) != (height + scale - 1) / scale)
+	{
+		return -1;
+	}
+	
+	return level;
+}
+
+
+// averages one proxy pixel's worth of a decoded strip, except for UINT
+// channels (IDs, usually) which get the top left sample instead
+static void
+BoxFilterPixel(PixelType type, const char *strip, size_t rowbytes, const Box2i &stripBox, const Box2i &pixBox, char *out)
+{
+	const size_t pix_size = PixelSize(type);
+	
+	const char *first = strip + (rowbytes * (pixBox.min.y - stripBox.min.y)) + (pix_size * (pixBox.min.x - stripBox.min.x));
+	
+	if(type == UINT)
+	{
+		memcpy(out, first, pix_size);
+		
+		return;
+	}
+	
+	const int width = (pixBox.max.x - pixBox.min.x) + 1;
+	const int height = (pixBox.max.y - pixBox.min.y) + 1;
+	
+	float total = 0.f;
+	
+	for(int y=0; y < height; y++)
+	{
+		const char *row = first + (rowbytes * y);
+		
+		if(type == HALF)
+		{
+			const half *pix = (const half *)row;
+			
+			for(int x=0; x < width; x++)
+				total += pix[x];
+		}
+		else
+		{
+			const float *pix = (const float *)row;
+			
+			for(int x=0; x < width; x++)
+				total += pix[x];
+		}
+	}
+	
+	const float average = total / (float)(width * height);
+	
+	if(type == HALF)
+	{
+		const half h = average;
+		
+		memcpy(out, &h, sizeof(half));
+	}
+	else
+		memcpy(out, &average, sizeof(float));
+}
 
 
 HybridInputFile::HybridInputFile(const char fileName[], bool renameFirstPart, int numThreads, bool reconstructChunkOffsetTable) :
 	_multiPart(fileName, numThreads, reconstructChunkOffsetTable),
-	_renameFirstPart(renameFirstPart)
+	_renameFirstPart(renameFirstPart),
+	_proxyScale(1),
+	_numThreads(numThreads),
+	_partPool(NULL)
 {
 	setup();
 }
@@ -46,7 +193,10 @@ HybridInputFile::HybridInputFile(const char fileName[], bool renameFirstPart, in
 
 HybridInputFile::HybridInputFile(IStream& is, bool renameFirstPart, int numThreads, bool reconstructChunkOffsetTable) :
 	_multiPart(is, numThreads, reconstructChunkOffsetTable),
-	_renameFirstPart(renameFirstPart)
+	_renameFirstPart(renameFirstPart),
+	_proxyScale(1),
+	_numThreads(numThreads),
+	_partPool(NULL)
 {
 	setup();
 }
@@ -65,55 +215,719 @@ HybridInputFile::isComplete() const
 }
 
 
+int
+HybridInputFile::partForChannel(const string &name) const
+{
+	HybridChannelMap::const_iterator i = _map.find(name);
+	
+	return (i != _map.end() ? i->second.part : -1);
+}
+
+
+string
+HybridInputFile::partChannelName(const string &name) const
+{
+	HybridChannelMap::const_iterator i = _map.find(name);
+	
+	return (i != _map.end() ? i->second.name : name);
+}
+
+
 void
-HybridInputFile::readPixels(int scanLine1, int scanLine2)
+HybridInputFile::setReadWindow(const Box2i &readWindow)
+{
+	_readWindow.min.x = max(readWindow.min.x, _dataWindow.min.x);
+	_readWindow.min.y = max(readWindow.min.y, _dataWindow.min.y);
+	_readWindow.max.x = min(readWindow.max.x, _dataWindow.max.x);
+	_readWindow.max.y = min(readWindow.max.y, _dataWindow.max.y);
+	
+	if( _readWindow.isEmpty() )
+		throw IEX_NAMESPACE::ArgExc("Read window is outside the data window");
+	
+	updateProxy();
+}
+
+
+void
+HybridInputFile::setProxyScale(int scale)
+{
+	if(scale < 1)
+		throw IEX_NAMESPACE::ArgExc("Proxy scale must be at least 1");
+	
+	_proxyScale = scale;
+	
+	updateProxy();
+}
+
+
+Box2i
+HybridInputFile::proxyBox(const Box2i &box) const
+{
+	Box2i proxy;
+	
+	proxy.min.x = ProxyCoord(box.min.x, _dataWindow.min.x, _proxyScale);
+	proxy.min.y = ProxyCoord(box.min.y, _dataWindow.min.y, _proxyScale);
+	proxy.max.x = ProxyCoord(box.max.x, _dataWindow.min.x, _proxyScale);
+	proxy.max.y = ProxyCoord(box.max.y, _dataWindow.min.y, _proxyScale);
+	
+	return proxy;
+}
+
+
+bool
+HybridInputFile::coversReadWindow() const
 {
 	for(int n=0; n < _multiPart.parts(); n++)
 	{
-		FrameBuffer part_fb;
+		const Header &head = _multiPart.header(n);
+		
+		if(head.type() != OPENEXR_IMF_INTERNAL_NAMESPACE::DEEPTILE)
+		{
+			const Box2i &dataW = head.dataWindow();
+			
+			if(dataW.min.x > _readWindow.min.x || dataW.min.y > _readWindow.min.y ||
+				dataW.max.x < _readWindow.max.x || dataW.max.y < _readWindow.max.y)
+			{
+				return false;
+			}
+		}
+	}
+	
+	return true;
+}
+
+
+// Everything needed to read one part, kept from one readPixels() to the
+// next: its piece of the hybrid frame buffer (split up once, when the
+// frame buffer is set) and the part readers, which only have to be told
+// about the frame buffer again after a cropped read borrowed them.
+class HybridPartReader
+{
+  public:
+	HybridPartReader(MultiPartInputFile &multiPart, int part);
+	~HybridPartReader();
+	
+	FrameBuffer & frameBuffer() { return _frameBuffer; }
+	void frameBufferChanged() { _frameBufferSet = false; }
+	
+	// how boxes map to the part, see HybridInputFile::setProxyScale()
+	void setProxy(int scale, const V2i &origin, int level);
+	int proxyLevel() const { return _level; }
+	
+	void read(const Box2i &box);
+	
+  private:
+	void readCropped(const FrameBuffer &frameBuffer, const Box2i &box, int level);
+	void readFiltered(const Box2i &box);
+	
+	Box2i levelDataWindow(int level) const;
+	
+	InputPart & inputPart(); // scanline parts only
+	TiledInputPart & tiledPart(); // tiled parts only
+	
+	MultiPartInputFile &_multiPart;
+	const int _part;
+	
+	FrameBuffer _frameBuffer;
+	bool _frameBufferSet; // does the part's reader have _frameBuffer?
+	
+	int _scale;
+	V2i _origin;
+	int _level;
+	
+	InputPart *_inputPart;
+	TiledInputPart *_tiledPart;
+	
+	Array<char> _strip;
+	size_t _strip_size;
+	
+	Array<char> _fullStrip; // full resolution pixels for readFiltered()
+	size_t _fullStrip_size;
+};
+
+
+HybridPartReader::HybridPartReader(MultiPartInputFile &multiPart, int part) :
+	_multiPart(multiPart),
+	_part(part),
+	_frameBufferSet(false),
+	_scale(1),
+	_origin(0, 0),
+	_level(0),
+	_inputPart(NULL),
+	_tiledPart(NULL),
+	_strip_size(0),
+	_fullStrip_size(0)
+{
+
+}
+
+
+HybridPartReader::~HybridPartReader()
+{
+	delete _inputPart;
+	delete _tiledPart;
+}
+
+
+InputPart &
+HybridPartReader::inputPart()
+{
+	if(_inputPart == NULL)
+		_inputPart = new InputPart(_multiPart, _part);
+	
+	return *_inputPart;
+}
+
+
+TiledInputPart &
+HybridPartReader::tiledPart()
+{
+	if(_tiledPart == NULL)
+		_tiledPart = new TiledInputPart(_multiPart, _part);
+	
+	return *_tiledPart;
+}
+
+
+void
+HybridPartReader::setProxy(int scale, const V2i &origin, int level)
+{
+	_scale = scale;
+	_origin = origin;
+	_level = level;
+}
+
+
+Box2i
+HybridPartReader::levelDataWindow(int level) const
+{
+	const Header &head = _multiPart.header(_part);
+	const Box2i &dataW = head.dataWindow();
+	
+	if(level == 0)
+		return dataW;
+	
+	const LevelRoundingMode rounding = head.tileDescription().roundingMode;
+	
+	Box2i levelW = dataW;
+	
+	levelW.max.x = dataW.min.x + LevelSize((dataW.max.x - dataW.min.x) + 1, level, rounding) - 1;
+	levelW.max.y = dataW.min.y + LevelSize((dataW.max.y - dataW.min.y) + 1, level, rounding) - 1;
 	
-		for(FrameBuffer::ConstIterator i = _frameBuffer.begin(); i != _frameBuffer.end(); i++)
+	return levelW;
+}
+
+
+void
+HybridPartReader::read(const Box2i &box)
+{
+	const Header &head = _multiPart.header(_part);
+	const Box2i &dataW = head.dataWindow();
+	
+	if(_scale > 1)
+	{
+		if(_level > 0)
+			readCropped(_frameBuffer, box, _level);
+		else
+			readFiltered(box);
+	}
+	else if(box.min.x == dataW.min.x && box.max.x == dataW.max.x)
+	{
+		// whole scanlines fit in the frame buffer
+		if( head.hasTileDescription() )
 		{
-			if( _map.find( i.name() ) != _map.end() )
+			// Tiled parts only ever get a TiledInputPart, OpenEXR can't have
+			// two kinds of reader on one part.  Tiles can reach past the box,
+			// so they only go straight in when it covers whole tile rows.
+			const int tile_height = head.tileDescription().ySize;
+			
+			const int tile_y1 = (box.min.y - dataW.min.y) / tile_height;
+			const int tile_y2 = (box.max.y - dataW.min.y) / tile_height;
+			
+			if(box.min.y == dataW.min.y + (tile_y1 * tile_height) &&
+				(box.max.y == dataW.max.y || box.max.y == dataW.min.y + ((tile_y2 + 1) * tile_height) - 1))
 			{
-				const HybridChannel &hyChan = _map[ i.name() ];
-				
-				if(hyChan.part == n)
+				if(!_frameBufferSet)
 				{
-					part_fb.insert( hyChan.name, i.slice() );
+					tiledPart().setFrameBuffer(_frameBuffer);
+					
+					_frameBufferSet = true;
 				}
+				
+				tiledPart().readTiles(0, tiledPart().numXTiles(0) - 1, tile_y1, tile_y2, 0, 0);
 			}
-			else if(n == 0)
+			else
+				readCropped(_frameBuffer, box, 0);
+		}
+		else
+		{
+			if(!_frameBufferSet)
 			{
-				// for channels that will be simply be filled
-				const bool rename = (_multiPart.parts() > 1);
+				inputPart().setFrameBuffer(_frameBuffer);
 				
-				const string name_never_loaded = (rename ? string("zzNOLOADzz") + i.name() : i.name());
+				_frameBufferSet = true;
+			}
+			
+			inputPart().readPixels(box.min.y, box.max.y);
+		}
+	}
+	else
+		readCropped(_frameBuffer, box, 0);
+}
+
+
+void
+HybridPartReader::readCropped(const FrameBuffer &frameBuffer, const Box2i &box, int level)
+{
+	// The part's scanlines are wider than the frame buffer, so we decode
+	// strips into our own buffer and copy out the columns that are wanted.
+	// For tiled parts the strip is just the tiles that intersect the box,
+	// and they can come from a smaller level.
+	const Header &head = _multiPart.header(_part);
+	const Box2i dataW = levelDataWindow(level);
+	
+	const bool tiled = head.hasTileDescription();
+	
+	int tile_width = 1, tile_height = 1;
+	int tile_x1 = 0, tile_x2 = 0;
+	
+	int strip_x_min = dataW.min.x;
+	int strip_x_max = dataW.max.x;
+	
+	if(tiled)
+	{
+		const TileDescription &tiles = head.tileDescription();
+		
+		tile_width = tiles.xSize;
+		tile_height = tiles.ySize;
+		
+		tile_x1 = (box.min.x - dataW.min.x) / tile_width;
+		tile_x2 = (box.max.x - dataW.min.x) / tile_width;
+		
+		strip_x_min = dataW.min.x + (tile_x1 * tile_width);
+		strip_x_max = min(dataW.min.x + ((tile_x2 + 1) * tile_width) - 1, dataW.max.x);
+	}
+	
+	const int strip_width = (strip_x_max - strip_x_min) + 1;
+	const int box_width = (box.max.x - box.min.x) + 1;
+	
+	size_t strip_rowbytes = 0;
+	
+	for(FrameBuffer::ConstIterator i = frameBuffer.begin(); i != frameBuffer.end(); ++i)
+	{
+		const Slice &slice = i.slice();
+		
+		if(slice.xSampling != 1 || slice.ySampling != 1 || slice.xTileCoords || slice.yTileCoords)
+			throw IEX_NAMESPACE::ArgExc("Can't crop subsampled or tile-relative slices");
+		
+		strip_rowbytes += PixelSize(slice.type) * strip_width;
+	}
+	
+	const int tile_rows_per_strip = max<int>(kCropStripBytes / max<size_t>(strip_rowbytes * tile_height, 1), 1);
+	
+	int y = box.min.y;
+	
+	while(y <= box.max.y)
+	{
+		int strip_y_min, strip_y_max;
+		int tile_y1 = 0, tile_y2 = 0;
+		
+		if(tiled)
+		{
+			tile_y1 = (y - dataW.min.y) / tile_height;
+			tile_y2 = min(tile_y1 + tile_rows_per_strip - 1, (box.max.y - dataW.min.y) / tile_height);
+			
+			strip_y_min = dataW.min.y + (tile_y1 * tile_height);
+			strip_y_max = min(dataW.min.y + ((tile_y2 + 1) * tile_height) - 1, dataW.max.y);
+		}
+		else
+		{
+			strip_y_min = y;
+			strip_y_max = min(y + tile_rows_per_strip - 1, box.max.y);
+		}
+		
+		const int strip_height = (strip_y_max - strip_y_min) + 1;
+		
+		// the strip is usually the same size every time
+		const size_t strip_size = strip_rowbytes * strip_height;
+		
+		if(strip_size > _strip_size)
+		{
+			_strip.resizeErase(strip_size);
+			
+			_strip_size = strip_size;
+		}
+		
+		FrameBuffer strip_fb;
+		
+		char *strip_slice = _strip;
+		
+		for(FrameBuffer::ConstIterator i = frameBuffer.begin(); i != frameBuffer.end(); ++i)
+		{
+			const Slice &slice = i.slice();
+			
+			const size_t pix_size = PixelSize(slice.type);
+			const size_t rowbytes = pix_size * strip_width;
+			
+			char *origin = strip_slice - (pix_size * strip_x_min) - (rowbytes * strip_y_min);
+			
+			strip_fb.insert(i.name(), Slice(slice.type, origin, pix_size, rowbytes, 1, 1, slice.fillValue));
+			
+			strip_slice += rowbytes * strip_height;
+		}
+		
+		if(tiled)
+		{
+			tiledPart().setFrameBuffer(strip_fb);
+			
+			_frameBufferSet = false;
+			
+			tiledPart().readTiles(tile_x1, tile_x2, tile_y1, tile_y2, level, level);
+		}
+		else
+		{
+			inputPart().setFrameBuffer(strip_fb);
+			
+			_frameBufferSet = false;
+			
+			inputPart().readPixels(strip_y_min, strip_y_max);
+		}
+		
+		// copy out what's in the box
+		const int copy_y_max = min(strip_y_max, box.max.y);
+		
+		strip_slice = _strip;
+		
+		for(FrameBuffer::ConstIterator i = frameBuffer.begin(); i != frameBuffer.end(); ++i)
+		{
+			const Slice &slice = i.slice();
+			
+			const size_t pix_size = PixelSize(slice.type);
+			const size_t rowbytes = pix_size * strip_width;
+			
+			for(int row = y; row <= copy_y_max; row++)
+			{
+				const char *in = strip_slice + (rowbytes * (row - strip_y_min)) + (pix_size * (box.min.x - strip_x_min));
+				char *out = slice.base + (slice.yStride * row) + (slice.xStride * box.min.x);
 				
-				part_fb.insert( name_never_loaded, i.slice() );
+				if(slice.xStride == pix_size)
+				{
+					memcpy(out, in, pix_size * box_width);
+				}
+				else
+				{
+					for(int x=0; x < box_width; x++)
+					{
+						memcpy(out, in, pix_size);
+						
+						in += pix_size;
+						out += slice.xStride;
+					}
+				}
 			}
+			
+			strip_slice += rowbytes * strip_height;
 		}
 		
-		if(part_fb.begin() != part_fb.end()) // i.e. it's not empty
+		y = copy_y_max + 1;
+	}
+}
+
+
+void
+HybridPartReader::readFiltered(const Box2i &box)
+{
+	// No level to read the proxy from, so decode the file pixels in strips
+	// and average each scale x scale block.  Blocks hanging off the edge
+	// of the part average whatever's there.
+	const Header &head = _multiPart.header(_part);
+	const Box2i &dataW = head.dataWindow();
+	
+	const bool tiled = head.hasTileDescription();
+	
+	Box2i fullBox;
+	
+	fullBox.min.x = max(_origin.x + ((box.min.x - _origin.x) * _scale), dataW.min.x);
+	fullBox.max.x = min(_origin.x + ((box.max.x - _origin.x + 1) * _scale) - 1, dataW.max.x);
+	
+	const int full_width = (fullBox.max.x - fullBox.min.x) + 1;
+	
+	size_t full_rowbytes = 0;
+	
+	for(FrameBuffer::ConstIterator i = _frameBuffer.begin(); i != _frameBuffer.end(); ++i)
+	{
+		const Slice &slice = i.slice();
+		
+		if(slice.xSampling != 1 || slice.ySampling != 1 || slice.xTileCoords || slice.yTileCoords)
+			throw IEX_NAMESPACE::ArgExc("Can't scale subsampled or tile-relative slices");
+		
+		full_rowbytes += PixelSize(slice.type) * full_width;
+	}
+	
+	const int rows_per_strip = max<int>(kCropStripBytes / max<size_t>(full_rowbytes * _scale, 1), 1);
+	
+	int y = box.min.y;
+	
+	while(y <= box.max.y)
+	{
+		const int proxy_y_max = min(y + rows_per_strip - 1, box.max.y);
+		
+		fullBox.min.y = max(_origin.y + ((y - _origin.y) * _scale), dataW.min.y);
+		fullBox.max.y = min(_origin.y + ((proxy_y_max - _origin.y + 1) * _scale) - 1, dataW.max.y);
+		
+		const int full_height = (fullBox.max.y - fullBox.min.y) + 1;
+		
+		const size_t strip_size = full_rowbytes * full_height;
+		
+		if(strip_size > _fullStrip_size)
+		{
+			_fullStrip.resizeErase(strip_size);
+			
+			_fullStrip_size = strip_size;
+		}
+		
+		FrameBuffer full_fb;
+		
+		char *strip_slice = _fullStrip;
+		
+		for(FrameBuffer::ConstIterator i = _frameBuffer.begin(); i != _frameBuffer.end(); ++i)
+		{
+			const Slice &slice = i.slice();
+			
+			const size_t pix_size = PixelSize(slice.type);
+			const size_t rowbytes = pix_size * full_width;
+			
+			char *origin = strip_slice - (pix_size * fullBox.min.x) - (rowbytes * fullBox.min.y);
+			
+			full_fb.insert(i.name(), Slice(slice.type, origin, pix_size, rowbytes, 1, 1, slice.fillValue));
+			
+			strip_slice += rowbytes * full_height;
+		}
+		
+		if(!tiled && fullBox.min.x == dataW.min.x && fullBox.max.x == dataW.max.x)
+		{
+			inputPart().setFrameBuffer(full_fb);
+			
+			_frameBufferSet = false;
+			
+			inputPart().readPixels(fullBox.min.y, fullBox.max.y);
+		}
+		else
+			readCropped(full_fb, fullBox, 0);
+		
+		// now shrink it into the frame buffer
+		strip_slice = _fullStrip;
+		
+		for(FrameBuffer::ConstIterator i = _frameBuffer.begin(); i != _frameBuffer.end(); ++i)
 		{
-			const Box2i &dataW = _multiPart.header(n).dataWindow();
+			const Slice &slice = i.slice();
 			
-			const int startScanline = max(scanLine1, dataW.min.y);
-			const int endScanline = min(scanLine2, dataW.max.y);
+			const size_t rowbytes = PixelSize(slice.type) * full_width;
 			
-			if(endScanline >= startScanline)
+			for(int py = y; py <= proxy_y_max; py++)
 			{
-				InputPart inPart(_multiPart, n);
+				Box2i pixBox;
 				
-				inPart.setFrameBuffer(part_fb);
+				const int full_y = _origin.y + ((py - _origin.y) * _scale);
 				
-				inPart.readPixels(startScanline, endScanline);
+				pixBox.min.y = max(full_y, fullBox.min.y);
+				pixBox.max.y = min(full_y + _scale - 1, fullBox.max.y);
+				
+				char *out = slice.base + (slice.yStride * py) + (slice.xStride * box.min.x);
+				
+				for(int px = box.min.x; px <= box.max.x; px++)
+				{
+					const int full_x = _origin.x + ((px - _origin.x) * _scale);
+					
+					pixBox.min.x = max(full_x, fullBox.min.x);
+					pixBox.max.x = min(full_x + _scale - 1, fullBox.max.x);
+					
+					BoxFilterPixel(slice.type, strip_slice, rowbytes, fullBox, pixBox, out);
+					
+					out += slice.xStride;
+				}
 			}
+			
+			strip_slice += rowbytes * full_height;
+		}
+		
+		y = proxy_y_max + 1;
+	}
+}
+
+
+// One part's share of a readPixels() call.  When it's read on the part
+// pool, errors are caught and kept so they can be thrown from the calling
+// thread once every part is done.
+class PartRead
+{
+  public:
+	PartRead(HybridPartReader *reader, const Box2i &box) :
+		_reader(reader), _box(box), _error(ERR_NONE) {}
+	
+	void read() { _reader->read(_box); } // errors go straight up
+	void readPooled();
+	void rethrow() const;
+	
+  private:
+	HybridPartReader *_reader;
+	Box2i _box;
+	
+	enum {
+		ERR_NONE = 0,
+		ERR_INPUT,
+		ERR_IO,
+		ERR_ALLOC,
+		ERR_OTHER
+	} _error;
+	
+	string _message;
+};
+
+void
+PartRead::readPooled()
+{
+	try
+	{
+		_reader->read(_box);
+	}
+	catch(IEX_NAMESPACE::InputExc &e) { _error = ERR_INPUT; _message = e.what(); }
+	catch(IEX_NAMESPACE::IoExc &e) { _error = ERR_IO; _message = e.what(); }
+	catch(bad_alloc &e) { _error = ERR_ALLOC; }
+	catch(exception &e) { _error = ERR_OTHER; _message = e.what(); }
+	catch(...) { _error = ERR_OTHER; _message = "Unknown error reading part"; }
+}
+
+void
+PartRead::rethrow() const
+{
+	switch(_error)
+	{
+		case ERR_NONE:	break;
+		case ERR_INPUT:	throw IEX_NAMESPACE::InputExc(_message);
+		case ERR_IO:	throw IEX_NAMESPACE::IoExc(_message);
+		case ERR_ALLOC:	throw bad_alloc();
+		default:		throw IEX_NAMESPACE::BaseExc(_message);
+	}
+}
+
+
+class PartReadTask : public Task
+{
+  public:
+	PartReadTask(TaskGroup *group, PartRead &partRead) :
+		Task(group), _partRead(partRead) {}
+	virtual ~PartReadTask() {}
+	
+	virtual void execute() { _partRead.readPooled(); }
+	
+  private:
+	PartRead &_partRead;
+};
+
+
+int
+HybridInputFile::proxyLevel(int part) const
+{
+	return _partReaders[part]->proxyLevel();
+}
+
+
+HybridInputFile::~HybridInputFile()
+{
+	delete _partPool;
+	
+	for(vector<HybridPartReader *>::iterator i = _partReaders.begin(); i != _partReaders.end(); ++i)
+		delete *i;
+}
+
+
+void
+HybridInputFile::setFrameBuffer(const FrameBuffer &frameBuffer)
+{
+	_frameBuffer = frameBuffer;
+	
+	// split it up by part now, instead of on every readPixels()
+	for(vector<HybridPartReader *>::iterator i = _partReaders.begin(); i != _partReaders.end(); ++i)
+	{
+		(*i)->frameBuffer() = FrameBuffer();
+		(*i)->frameBufferChanged();
+	}
+	
+	for(FrameBuffer::ConstIterator i = _frameBuffer.begin(); i != _frameBuffer.end(); i++)
+	{
+		HybridChannelMap::const_iterator hyChan = _map.find( i.name() );
+		
+		if(hyChan != _map.end())
+		{
+			_partReaders[hyChan->second.part]->frameBuffer().insert(hyChan->second.name, i.slice());
+		}
+		else
+		{
+			// for channels that will be simply be filled
+			const bool rename = (_multiPart.parts() > 1);
+			
+			const string name_never_loaded = (rename ? string("zzNOLOADzz") + i.name() : i.name());
+			
+			_partReaders[0]->frameBuffer().insert(name_never_loaded, i.slice());
 		}
 	}
 }
 
 
+void
+HybridInputFile::readPixels(int scanLine1, int scanLine2)
+{
+	vector<PartRead> partReads;
+	
+	for(int n=0; n < _multiPart.parts(); n++)
+	{
+		HybridPartReader *reader = _partReaders[n];
+		
+		if(reader->frameBuffer().begin() != reader->frameBuffer().end()) // i.e. it's not empty
+		{
+			const Box2i partW = proxyBox( _multiPart.header(n).dataWindow() );
+			
+			// what this part has to contribute
+			Box2i readBox;
+			
+			readBox.min.x = max(partW.min.x, _proxyWindow.min.x);
+			readBox.max.x = min(partW.max.x, _proxyWindow.max.x);
+			readBox.min.y = max(max(scanLine1, partW.min.y), _proxyWindow.min.y);
+			readBox.max.y = min(min(scanLine2, partW.max.y), _proxyWindow.max.y);
+			
+			if( !readBox.isEmpty() )
+				partReads.push_back( PartRead(reader, readBox) );
+		}
+	}
+	
+	// the pool only gets made once there's more than one part to read
+	if(partReads.size() > 1 && _partPool == NULL && _numThreads > 0 && ILMTHREAD_NAMESPACE::supportsThreads())
+		_partPool = new ThreadPool( min(_numThreads, _multiPart.parts()) );
+	
+	if(partReads.size() > 1 && _partPool != NULL)
+	{
+		// Parts are independent, so decode them all at once.  They get their own
+		// pool because each part's readPixels() farms out its line buffers to
+		// the global one and waits, which would deadlock if we were in there too.
+		{
+			TaskGroup taskGroup;
+			
+			for(vector<PartRead>::iterator i = partReads.begin(); i != partReads.end(); ++i)
+				_partPool->addTask(new PartReadTask(&taskGroup, *i));
+		}
+		
+		for(vector<PartRead>::const_iterator i = partReads.begin(); i != partReads.end(); ++i)
+			i->rethrow();
+	}
+	else
+	{
+		for(vector<PartRead>::iterator i = partReads.begin(); i != partReads.end(); ++i)
+			i->read();
+	}
+}
+
+
 void
 HybridInputFile::setup()
 {
@@ -147,6 +961,23 @@ HybridInputFile::setup()
 	
 	if(_chanList.begin() == _chanList.end()) // empty
 		throw IEX_NAMESPACE::BaseExc("DeepTile images not supported");  // only reason this should happen
+	
+	_readWindow = _dataWindow;
+	
+	for(int n=0; n < _multiPart.parts(); n++)
+		_partReaders.push_back( new HybridPartReader(_multiPart, n) );
+	
+	updateProxy();
+}
+
+
+void
+HybridInputFile::updateProxy()
+{
+	_proxyWindow = proxyBox(_readWindow);
+	
+	for(int n=0; n < _multiPart.parts(); n++)
+		_partReaders[n]->setProxy(_proxyScale, _dataWindow.min, ProxyLevel(_multiPart.header(n), _dataWindow.min, _proxyScale));
 }
 
 
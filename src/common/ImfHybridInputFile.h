@@ -30,11 +30,14 @@
 #include "ImfFrameBuffer.h"
 #include "ImfChannelList.h"
 #include "ImathBox.h"
+#include "IlmThreadPool.h"
 
 
 OPENEXR_IMF_INTERNAL_NAMESPACE_HEADER_ENTER
 
 
+class HybridPartReader;
+
 class IMF_EXPORT HybridInputFile : public GenericInputFile
 {
   public:
@@ -46,7 +49,7 @@ class IMF_EXPORT HybridInputFile : public GenericInputFile
 					int numThreads = globalThreadCount(),
 					bool reconstructChunkOffsetTable = true);
 
-	virtual ~HybridInputFile() {}
+	virtual ~HybridInputFile();
 	
 	
 	int parts() const { return _multiPart.parts(); }
@@ -59,11 +62,41 @@ class IMF_EXPORT HybridInputFile : public GenericInputFile
 	
 	const ChannelList &		channels () const { return _chanList; }
 	
+	// which part a hybrid channel comes from, and what it's called there
+	int				partForChannel (const std::string &name) const;
+	std::string		partChannelName (const std::string &name) const;
+	
 	const IMATH_NAMESPACE::Box2i & dataWindow() const { return _dataWindow; }
 	const IMATH_NAMESPACE::Box2i & displayWindow() const { return _displayWindow; }
 	
+	// Only decode the part of the data window inside readWindow (clipped to
+	// the data window).  The frame buffer then only has to hold the read window,
+	// scanlines outside are skipped, and tiles outside are never touched.
+	void		setReadWindow (const IMATH_NAMESPACE::Box2i &readWindow);
+	const IMATH_NAMESPACE::Box2i & readWindow() const { return _readWindow; }
+	
+	// true if readPixels() writes every pixel of the read window, i.e. the
+	// parts all cover it, otherwise the frame buffer should start out cleared
+	bool		coversReadWindow () const;
+	
+	// Read at 1/scale resolution.  A tiled part with a MIPMAP or RIPMAP level
+	// that size is read from the level, anything else is box filtered as it's
+	// decoded.  The frame buffer and readPixels() scanlines are then in proxy
+	// pixels: proxyWindow() is the read window scaled down around the data
+	// window's origin.  A scale of 1 (the default) reads the file as is.
+	void		setProxyScale (int scale);
+	int			proxyScale () const { return _proxyScale; }
+	
+	const IMATH_NAMESPACE::Box2i & proxyWindow() const { return _proxyWindow; }
+	
+	// some box of file pixels, in proxy pixels
+	IMATH_NAMESPACE::Box2i	proxyBox (const IMATH_NAMESPACE::Box2i &box) const;
 	
-	void		setFrameBuffer (const FrameBuffer &frameBuffer) { _frameBuffer = frameBuffer; }
+	// the level a part's proxy comes from, or -1 if it's being filtered
+	int			proxyLevel (int part) const;
+	
+	
+	void		setFrameBuffer (const FrameBuffer &frameBuffer);
 	
 	const FrameBuffer &	frameBuffer () const { return _frameBuffer; }
 	
@@ -72,6 +105,7 @@ class IMF_EXPORT HybridInputFile : public GenericInputFile
 	
   private:
 	void setup();
+	void updateProxy();
 
   private:
 	MultiPartInputFile _multiPart;
@@ -80,6 +114,10 @@ class IMF_EXPORT HybridInputFile : public GenericInputFile
 	
 	IMATH_NAMESPACE::Box2i _dataWindow;
 	IMATH_NAMESPACE::Box2i _displayWindow;
+	IMATH_NAMESPACE::Box2i _readWindow;
+	
+	int _proxyScale;
+	IMATH_NAMESPACE::Box2i _proxyWindow;
 	
 	FrameBuffer		_frameBuffer;
 	
@@ -95,6 +133,11 @@ class IMF_EXPORT HybridInputFile : public GenericInputFile
 	HybridChannelMap _map;
 	
 	ChannelList _chanList;
+	
+	std::vector<HybridPartReader *> _partReaders;
+	
+	int _numThreads;
+	ILMTHREAD_NAMESPACE::ThreadPool *_partPool; // for reading parts at the same time, made when first needed
 };
 
 
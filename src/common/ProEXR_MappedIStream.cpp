@@ -0,0 +1,217 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+
+#include "ProEXR_MappedIStream.h"
+
+#ifndef WIN32
+
+#include <Iex.h>
+
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+
+using namespace Imf;
+using namespace Iex;
+using namespace std;
+
+
+MappedIStream::MappedIStream(const char fileName[]) :
+	IStream(fileName),
+	_fd(-1),
+	_map(NULL),
+	_size(0),
+	_pos(0)
+{
+	_fd = open(fileName, O_RDONLY);
+
+	if(_fd < 0)
+		throwErrnoExc();
+
+	struct stat st;
+
+	if(fstat(_fd, &st) != 0)
+	{
+		const int err = errno;
+
+		close(_fd);
+
+		throwErrnoExc("Can't get the size of " + string(fileName) + " (%T).", err);
+	}
+
+	if( !S_ISREG(st.st_mode) )
+	{
+		// pipes and such have no size, and OpenEXR has to seek around
+		close(_fd);
+
+		throw IoExc(string(fileName) + " is not a regular file.");
+	}
+
+	_size = st.st_size;
+
+	// an empty file can't be mapped, and a 32-bit process might not have room
+	if( _size > 0 && (uint64_t)_size <= (uint64_t)SIZE_MAX )
+	{
+		void *map = mmap(NULL, (size_t)_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+
+		if(map != MAP_FAILED)
+		{
+			_map = (char *)map;
+
+			// the mapping keeps the file open
+			close(_fd);
+
+			_fd = -1;
+		}
+	}
+}
+
+
+MappedIStream::~MappedIStream()
+{
+	if(_map)
+		munmap(_map, (size_t)_size);
+
+	if(_fd >= 0)
+		close(_fd);
+}
+
+
+bool
+MappedIStream::isMemoryMapped() const
+{
+	return (_map != NULL);
+}
+
+
+bool
+MappedIStream::read(char c[/*n*/], int n)
+{
+	if(n < 0 || _pos + n > _size)
+		throw InputExc("Unexpected end of file.");
+
+	if(_map)
+	{
+		memcpy(c, _map + _pos, n);
+	}
+	else
+	{
+		int done = 0;
+
+		while(done < n)
+		{
+			const ssize_t got = pread(_fd, c + done, n - done, _pos + done);
+
+			if(got < 0 && errno == EINTR)
+				continue;
+			else if(got < 0)
+				throwErrnoExc();
+			else if(got == 0)
+				throw InputExc("Unexpected end of file.");
+
+			done += got;
+		}
+	}
+
+	_pos += n;
+
+	return true;
+}
+
+
+char *
+MappedIStream::readMemoryMapped(int n)
+{
+	if(_map == NULL)
+		throw LogicExc("File is not memory mapped.");
+
+	if(n < 0 || _pos + n > _size)
+		throw InputExc("Unexpected end of file.");
+
+	char *data = _map + _pos;
+
+	_pos += n;
+
+	return data;
+}
+
+
+Int64
+MappedIStream::tellg()
+{
+	return _pos;
+}
+
+
+void
+MappedIStream::seekg(Int64 pos)
+{
+	_pos = pos;
+}
+
+
+void
+MappedIStream::advise(Access access)
+{
+	if(_map)
+	{
+		const int advice = (access == ACCESS_SEQUENTIAL ? POSIX_MADV_SEQUENTIAL :
+							access == ACCESS_RANDOM ? POSIX_MADV_RANDOM :
+							POSIX_MADV_NORMAL);
+
+		posix_madvise(_map, (size_t)_size, advice); // only a hint, so errors don't matter
+	}
+#ifdef POSIX_FADV_SEQUENTIAL
+	else if(_fd >= 0)
+	{
+		const int advice = (access == ACCESS_SEQUENTIAL ? POSIX_FADV_SEQUENTIAL :
+							access == ACCESS_RANDOM ? POSIX_FADV_RANDOM :
+							POSIX_FADV_NORMAL);
+
+		posix_fadvise(_fd, 0, 0, advice);
+	}
+#endif
+}
+
+
+MappedIStream::Access
+MappedIStream::accessFor(const HybridInputFile &file)
+{
+	// scanline parts get read top to bottom, even when there are several
+	// of them going at once, but tiles and levels jump all over the place
+	for(int n=0; n < file.parts(); n++)
+	{
+		if( file.header(n).hasTileDescription() )
+			return ACCESS_RANDOM;
+	}
+
+	return ACCESS_SEQUENTIAL;
+}
+
+#endif // WIN32
@@ -0,0 +1,77 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+
+
+#ifndef PROEXR_MAPPEDISTREAM_H
+#define PROEXR_MAPPEDISTREAM_H
+
+#ifndef WIN32
+
+#include <ImfIO.h>
+
+#include "ImfHybridInputFile.h"
+
+// An Imf::IStream that mmaps the file instead of reading it into memory.
+// readMemoryMapped() hands OpenEXR pointers straight into the mapping, so
+// chunks get decoded out of the page cache without a copy, and pages are
+// only read in as the decoder gets to them.  Files that can't be mapped
+// (empty, or too big for a 32-bit process) are read with pread() instead.
+// It has to be a regular file; pipes and devices are rejected.
+//
+// POSIX only.  Don't use it on a file something else might still be
+// writing: reading past a truncated end is a SIGBUS, not an exception.
+
+class MappedIStream : public Imf::IStream
+{
+  public:
+	MappedIStream(const char fileName[]); // throws like StdIFStream
+	virtual ~MappedIStream();
+
+	virtual bool isMemoryMapped() const;
+	virtual bool read(char c[/*n*/], int n);
+	virtual char *readMemoryMapped(int n);
+	virtual Imf::Int64 tellg();
+	virtual void seekg(Imf::Int64 pos);
+
+	// tell the kernel how the pixels are going to be read, so it knows
+	// whether to read ahead (scanlines) or not bother (tiles)
+	enum Access {
+		ACCESS_NORMAL = 0,
+		ACCESS_SEQUENTIAL,
+		ACCESS_RANDOM
+	};
+
+	void advise(Access access);
+
+	static Access accessFor(const Imf::HybridInputFile &file); // random if any part is tiled
+
+  private:
+	int _fd;
+	char *_map;
+	Imf::Int64 _size;
+	Imf::Int64 _pos;
+};
+
+#endif // WIN32
+
+#endif // PROEXR_MAPPEDISTREAM_H
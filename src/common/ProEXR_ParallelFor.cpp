@@ -0,0 +1,215 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+#include "ProEXR_ParallelFor.h"
+
+#include <IlmThread.h>
+#include <IlmThreadPool.h>
+#include <IlmThreadMutex.h>
+
+#include <Iex.h>
+
+#include <string>
+#include <new>
+
+#include <assert.h>
+
+
+using namespace IlmThread;
+using namespace std;
+
+
+#ifndef MAX
+	#define MAX(A,B)	((A) > (B) ? (A) : (B))
+#endif
+
+#ifndef MIN
+	#define MIN(A,B)	((A) < (B) ? (A) : (B))
+#endif
+
+
+// about half a typical L2, so a chunk's rows are still around when the
+// next pass over the same pixels (if any) comes through
+static const size_t kChunkBytes = (256 * 1024);
+
+// enough chunks per thread that a slow one doesn't hold everybody up
+static const int kChunksPerThread = 4;
+
+
+// An exception can't be allowed out of a pool thread, so the first one
+// is kept, the rest of the chunks are dropped, and rethrow() throws it
+// on the calling thread once everybody's done.
+class RowChunkQueue
+{
+  public:
+	RowChunkQueue(int height, int chunk_rows) : _height(height), _chunk_rows(chunk_rows), _next_row(0), _error(ERR_NONE) {}
+	~RowChunkQueue() {}
+
+	void run(ParallelRowKernel &kernel);
+	void rethrow() const;
+
+  private:
+	bool nextChunk(int &y_start, int &y_end);
+	void fail(int error, const string &message);
+
+	const int _height;
+	const int _chunk_rows;
+
+	Mutex _mutex;
+	int _next_row;
+
+	enum {
+		ERR_NONE = 0,
+		ERR_ALLOC,
+		ERR_OTHER
+	};
+
+	int _error;
+	string _message;
+};
+
+bool
+RowChunkQueue::nextChunk(int &y_start, int &y_end)
+{
+	Lock lock(_mutex);
+
+	if(_next_row >= _height)
+		return false;
+
+	y_start = _next_row;
+	y_end = MIN(_next_row + _chunk_rows, _height);
+
+	_next_row = y_end;
+
+	return true;
+}
+
+void
+RowChunkQueue::fail(int error, const string &message)
+{
+	Lock lock(_mutex);
+
+	if(_error == ERR_NONE)
+	{
+		_error = error;
+		_message = message;
+	}
+
+	_next_row = _height; // nobody gets another chunk
+}
+
+void
+RowChunkQueue::run(ParallelRowKernel &kernel)
+{
+	int y_start, y_end;
+
+	try
+	{
+		while( nextChunk(y_start, y_end) )
+		{
+			kernel.processRows(y_start, y_end);
+		}
+	}
+	catch(bad_alloc &e) { fail(ERR_ALLOC, ""); }
+	catch(exception &e) { fail(ERR_OTHER, e.what()); }
+	catch(...) { fail(ERR_OTHER, "Unknown error processing rows"); }
+}
+
+void
+RowChunkQueue::rethrow() const
+{
+	// the tasks are done, no need to lock
+	switch(_error)
+	{
+		case ERR_NONE:	break;
+		case ERR_ALLOC:	throw bad_alloc();
+		default:		throw Iex::BaseExc(_message);
+	}
+}
+
+
+class RowChunkTask : public Task
+{
+  public:
+	RowChunkTask(TaskGroup *group, RowChunkQueue &queue, ParallelRowKernel &kernel);
+	virtual ~RowChunkTask() {}
+
+	virtual void execute();
+
+  private:
+	RowChunkQueue &_queue;
+	ParallelRowKernel &_kernel;
+};
+
+RowChunkTask::RowChunkTask(TaskGroup *group, RowChunkQueue &queue, ParallelRowKernel &kernel) :
+	Task(group),
+	_queue(queue),
+	_kernel(kernel)
+{
+
+}
+
+void
+RowChunkTask::execute()
+{
+	_queue.run(_kernel);
+}
+
+
+void
+ParallelForRows(ParallelRowKernel &kernel, int height, size_t bytes_per_row)
+{
+	if(height <= 0)
+		return;
+
+	const int threads = (supportsThreads() ? ThreadPool::globalThreadPool().numThreads() : 0);
+
+	int chunk_rows = MAX(kChunkBytes / MAX(bytes_per_row, (size_t)1), (size_t)1);
+
+	if(threads > 0)
+		chunk_rows = MIN(chunk_rows, MAX((height + (threads * kChunksPerThread) - 1) / (threads * kChunksPerThread), 1));
+
+	const int chunks = (height + chunk_rows - 1) / chunk_rows;
+
+	if(threads == 0 || chunks == 1)
+	{
+		kernel.processRows(0, height);
+	}
+	else
+	{
+		RowChunkQueue queue(height, chunk_rows);
+
+		{
+			TaskGroup taskGroup; // waits for the tasks when it goes
+
+			// this thread works too, so one fewer helper
+			const int helpers = MIN(threads, chunks - 1);
+
+			for(int i=0; i < helpers; i++)
+				ThreadPool::addGlobalTask(new RowChunkTask(&taskGroup, queue, kernel));
+
+			queue.run(kernel);
+		}
+
+		queue.rethrow();
+	}
+}
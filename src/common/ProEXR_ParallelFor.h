@@ -0,0 +1,48 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+
+#ifndef PROEXR_PARALLELFOR_H
+#define PROEXR_PARALLELFOR_H
+
+#include <stddef.h>
+
+// Splits rows [0, height) into chunks of a few hundred KB each and runs
+// them on the IlmThread global pool.  Only one Task per thread gets
+// queued; the tasks (and the calling thread) pull chunks until they're
+// gone, so there's no per-row allocation or queue traffic.
+
+class ParallelRowKernel
+{
+  public:
+	virtual ~ParallelRowKernel() {}
+
+	virtual void processRows(int y_start, int y_end) = 0; // [y_start, y_end)
+};
+
+
+// bytes_per_row is how much memory one row touches, summed over all
+// buffers, which is what decides the chunk size
+void ParallelForRows(ParallelRowKernel &kernel, int height, size_t bytes_per_row);
+
+
+#endif // PROEXR_PARALLELFOR_H
@@ -0,0 +1,1029 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+#include "ProEXR_PixelKernels.h"
+
+#include <half.h>
+
+#include <limits>
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define PROEXR_X86 1
+
+	#include <emmintrin.h>
+
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+
+		#if _MSC_VER >= 1700
+			#include <immintrin.h>
+			#define PROEXR_AVX2 1
+		#endif
+
+		// MSVC lets us use any intrinsic without special flags
+		#define PROEXR_TARGET_SSE2
+		#define PROEXR_TARGET_AVX2
+	#elif defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+		#include <immintrin.h>
+		#define PROEXR_AVX2 1
+
+		#include <cpuid.h>
+
+		#define PROEXR_TARGET_SSE2	__attribute__((target("sse2")))
+		#define PROEXR_TARGET_AVX2	__attribute__((target("avx2,f16c")))
+	#else
+		#define PROEXR_TARGET_SSE2
+	#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	// 32-bit NEON flushes denormals and can't divide, so it wouldn't match
+	#define PROEXR_NEON 1
+
+	#include <arm_neon.h>
+#endif
+
+
+// The vector versions all compute the new value for every pixel and then
+// select it only where the scalar code would have written, so pixels
+// the scalar loop skips keep their exact bits (NaN payloads, -0, etc).
+
+#pragma mark-
+
+
+static void
+PremultiplyRow_Scalar(float *color, const float *alpha, int length)
+{
+	for(int x=0; x < length; x++)
+	{
+		if(*alpha < 1.f)
+			*color *= *alpha;
+
+		color++;
+		alpha++;
+	}
+}
+
+static void
+UnMultiplyRow_Scalar(float *color, const float *alpha, int length)
+{
+	for(int x=0; x < length; x++)
+	{
+		if(*alpha > 0.f && *alpha < 1.f)
+			*color /= *alpha;
+
+		color++;
+		alpha++;
+	}
+}
+
+static void
+AlphaClipRow_Scalar(float *alpha, int length)
+{
+	for(int x=0; x < length; x++)
+	{
+		if(*alpha < 0.f)
+			*alpha = 0.f;
+		else if(*alpha > 1.f)
+			*alpha = 1.f;
+
+		alpha++;
+	}
+}
+
+static void
+KillNaNRow_Scalar(float *pix, int length)
+{
+	// the old -inf test could never match (it required a mantissa), so
+	// only NaN and +inf get replaced
+	for(int x=0; x < length; x++)
+	{
+		unsigned int l;
+		memcpy(&l, pix, sizeof(l));
+
+		if( (l & 0x7f800000) == 0x7f800000 && (l & 0x007fffff) != 0 )
+			*pix = 12.f;
+		else if(l == 0x7f800000)
+			*pix = 123.f;
+
+		pix++;
+	}
+}
+
+static void
+PixelStatsRow_Scalar(const float *pix, int length, PixelRowStats *stats)
+{
+	for(int x=0; x < length; x++)
+	{
+		unsigned int l;
+		memcpy(&l, pix, sizeof(l));
+
+		if( (l & 0x7fffffff) > 0x7f800000 )
+			stats->nans++;
+		else if(l == 0x7f800000)
+			stats->pos_infs++;
+		else if(l == 0xff800000)
+			stats->neg_infs++;
+		else
+		{
+			const float v = *pix;
+
+			if(v < 0.f)
+				stats->negatives++;
+
+			if(v < stats->min)
+				stats->min = v;
+
+			if(v > stats->max)
+				stats->max = v;
+
+			stats->sum += v;
+		}
+
+		pix++;
+	}
+}
+
+// half's own conversions: a table lookup going to float, and the
+// exponent table with round-to-nearest-even coming from float
+static void
+FloatToHalfRow_Scalar(const float *in, half *out, int length)
+{
+	for(int x=0; x < length; x++)
+		*out++ = *in++;
+}
+
+static void
+HalfToFloatRow_Scalar(const half *in, float *out, int length)
+{
+	for(int x=0; x < length; x++)
+		*out++ = *in++;
+}
+
+static void
+SplitRgbaRow_Scalar(const half *rgba, float *r, float *g, float *b, float *a, int length)
+{
+	for(int x=0; x < length; x++)
+	{
+		r[x] = rgba[0];
+		g[x] = rgba[1];
+		b[x] = rgba[2];
+		
+		if(a)
+			a[x] = rgba[3];
+		
+		rgba += 4;
+	}
+}
+
+
+#pragma mark-
+
+
+#ifdef PROEXR_X86
+
+PROEXR_TARGET_SSE2 static inline __m128
+Select_SSE2(__m128 mask, __m128 yes, __m128 no)
+{
+	return _mm_or_ps(_mm_and_ps(mask, yes), _mm_andnot_ps(mask, no));
+}
+
+PROEXR_TARGET_SSE2 static void
+PremultiplyRow_SSE2(float *color, const float *alpha, int length)
+{
+	const __m128 one = _mm_set1_ps(1.f);
+
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const __m128 c = _mm_loadu_ps(color + x);
+		const __m128 a = _mm_loadu_ps(alpha + x);
+
+		const __m128 mask = _mm_cmplt_ps(a, one);
+
+		_mm_storeu_ps(color + x, Select_SSE2(mask, _mm_mul_ps(c, a), c));
+	}
+
+	PremultiplyRow_Scalar(color + x, alpha + x, length - x);
+}
+
+PROEXR_TARGET_SSE2 static void
+UnMultiplyRow_SSE2(float *color, const float *alpha, int length)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const __m128 c = _mm_loadu_ps(color + x);
+		const __m128 a = _mm_loadu_ps(alpha + x);
+
+		const __m128 mask = _mm_and_ps(_mm_cmpgt_ps(a, zero), _mm_cmplt_ps(a, one));
+
+		_mm_storeu_ps(color + x, Select_SSE2(mask, _mm_div_ps(c, a), c));
+	}
+
+	UnMultiplyRow_Scalar(color + x, alpha + x, length - x);
+}
+
+PROEXR_TARGET_SSE2 static void
+AlphaClipRow_SSE2(float *alpha, int length)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		__m128 a = _mm_loadu_ps(alpha + x);
+
+		a = Select_SSE2(_mm_cmplt_ps(a, zero), zero, a);
+		a = Select_SSE2(_mm_cmpgt_ps(a, one), one, a);
+
+		_mm_storeu_ps(alpha + x, a);
+	}
+
+	AlphaClipRow_Scalar(alpha + x, length - x);
+}
+
+PROEXR_TARGET_SSE2 static void
+KillNaNRow_SSE2(float *pix, int length)
+{
+	const __m128i abs_mask = _mm_set1_epi32(0x7fffffff);
+	const __m128i inf = _mm_set1_epi32(0x7f800000);
+	const __m128 nan_val = _mm_set1_ps(12.f);
+	const __m128 inf_val = _mm_set1_ps(123.f);
+
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const __m128i l = _mm_loadu_si128((const __m128i *)(pix + x));
+
+		// with the sign bit off, anything above inf is a NaN
+		const __m128 is_nan = _mm_castsi128_ps( _mm_cmpgt_epi32(_mm_and_si128(l, abs_mask), inf) );
+		const __m128 is_inf = _mm_castsi128_ps( _mm_cmpeq_epi32(l, inf) );
+
+		__m128 p = _mm_castsi128_ps(l);
+
+		p = Select_SSE2(is_nan, nan_val, p);
+		p = Select_SSE2(is_inf, inf_val, p);
+
+		_mm_storeu_ps(pix + x, p);
+	}
+
+	KillNaNRow_Scalar(pix + x, length - x);
+}
+
+// counts go up by subtracting the all-ones compare masks, and anything
+// that isn't finite becomes +inf for the min, -inf for the max and 0 for the sum
+PROEXR_TARGET_SSE2 static void
+PixelStatsRow_SSE2(const float *pix, int length, PixelRowStats *stats)
+{
+	const __m128i abs_mask = _mm_set1_epi32(0x7fffffff);
+	const __m128i inf = _mm_set1_epi32(0x7f800000);
+	const __m128i neg_inf = _mm_set1_epi32(0xff800000);
+	const __m128 pos_inf_val = _mm_castsi128_ps(inf);
+	const __m128 neg_inf_val = _mm_castsi128_ps(neg_inf);
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128i nans = _mm_setzero_si128();
+	__m128i pos_infs = _mm_setzero_si128();
+	__m128i neg_infs = _mm_setzero_si128();
+	__m128i negatives = _mm_setzero_si128();
+	__m128 min = pos_inf_val;
+	__m128 max = neg_inf_val;
+	__m128d sum_lo = _mm_setzero_pd();
+	__m128d sum_hi = _mm_setzero_pd();
+
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const __m128i l = _mm_loadu_si128((const __m128i *)(pix + x));
+		const __m128i a = _mm_and_si128(l, abs_mask);
+
+		const __m128 finite = _mm_castsi128_ps( _mm_cmplt_epi32(a, inf) );
+
+		const __m128 p = _mm_castsi128_ps(l);
+
+		nans = _mm_sub_epi32(nans, _mm_cmpgt_epi32(a, inf));
+		pos_infs = _mm_sub_epi32(pos_infs, _mm_cmpeq_epi32(l, inf));
+		neg_infs = _mm_sub_epi32(neg_infs, _mm_cmpeq_epi32(l, neg_inf));
+		negatives = _mm_sub_epi32(negatives, _mm_castps_si128( _mm_and_ps(finite, _mm_cmplt_ps(p, zero)) ));
+
+		min = _mm_min_ps(min, Select_SSE2(finite, p, pos_inf_val));
+		max = _mm_max_ps(max, Select_SSE2(finite, p, neg_inf_val));
+
+		const __m128 s = _mm_and_ps(finite, p);
+
+		sum_lo = _mm_add_pd(sum_lo, _mm_cvtps_pd(s));
+		sum_hi = _mm_add_pd(sum_hi, _mm_cvtps_pd(_mm_movehl_ps(s, s)));
+	}
+
+	int counts[4][4];
+	float mins[4], maxes[4];
+	double sums[4];
+
+	_mm_storeu_si128((__m128i *)counts[0], nans);
+	_mm_storeu_si128((__m128i *)counts[1], pos_infs);
+	_mm_storeu_si128((__m128i *)counts[2], neg_infs);
+	_mm_storeu_si128((__m128i *)counts[3], negatives);
+	_mm_storeu_ps(mins, min);
+	_mm_storeu_ps(maxes, max);
+	_mm_storeu_pd(sums + 0, sum_lo);
+	_mm_storeu_pd(sums + 2, sum_hi);
+
+	for(int i=0; i < 4; i++)
+	{
+		stats->nans += counts[0][i];
+		stats->pos_infs += counts[1][i];
+		stats->neg_infs += counts[2][i];
+		stats->negatives += counts[3][i];
+
+		if(mins[i] < stats->min)
+			stats->min = mins[i];
+
+		if(maxes[i] > stats->max)
+			stats->max = maxes[i];
+
+		stats->sum += sums[i];
+	}
+
+	PixelStatsRow_Scalar(pix + x, length - x, stats);
+}
+
+
+#ifdef PROEXR_AVX2
+
+PROEXR_TARGET_AVX2 static void
+PremultiplyRow_AVX2(float *color, const float *alpha, int length)
+{
+	const __m256 one = _mm256_set1_ps(1.f);
+
+	int x = 0;
+
+	for(; x + 8 <= length; x += 8)
+	{
+		const __m256 c = _mm256_loadu_ps(color + x);
+		const __m256 a = _mm256_loadu_ps(alpha + x);
+
+		const __m256 mask = _mm256_cmp_ps(a, one, _CMP_LT_OQ);
+
+		_mm256_storeu_ps(color + x, _mm256_blendv_ps(c, _mm256_mul_ps(c, a), mask));
+	}
+
+	PremultiplyRow_Scalar(color + x, alpha + x, length - x);
+}
+
+PROEXR_TARGET_AVX2 static void
+UnMultiplyRow_AVX2(float *color, const float *alpha, int length)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.f);
+
+	int x = 0;
+
+	for(; x + 8 <= length; x += 8)
+	{
+		const __m256 c = _mm256_loadu_ps(color + x);
+		const __m256 a = _mm256_loadu_ps(alpha + x);
+
+		const __m256 mask = _mm256_and_ps(_mm256_cmp_ps(a, zero, _CMP_GT_OQ), _mm256_cmp_ps(a, one, _CMP_LT_OQ));
+
+		_mm256_storeu_ps(color + x, _mm256_blendv_ps(c, _mm256_div_ps(c, a), mask));
+	}
+
+	UnMultiplyRow_Scalar(color + x, alpha + x, length - x);
+}
+
+PROEXR_TARGET_AVX2 static void
+AlphaClipRow_AVX2(float *alpha, int length)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.f);
+
+	int x = 0;
+
+	for(; x + 8 <= length; x += 8)
+	{
+		__m256 a = _mm256_loadu_ps(alpha + x);
+
+		a = _mm256_blendv_ps(a, zero, _mm256_cmp_ps(a, zero, _CMP_LT_OQ));
+		a = _mm256_blendv_ps(a, one, _mm256_cmp_ps(a, one, _CMP_GT_OQ));
+
+		_mm256_storeu_ps(alpha + x, a);
+	}
+
+	AlphaClipRow_Scalar(alpha + x, length - x);
+}
+
+PROEXR_TARGET_AVX2 static void
+KillNaNRow_AVX2(float *pix, int length)
+{
+	const __m256i abs_mask = _mm256_set1_epi32(0x7fffffff);
+	const __m256i inf = _mm256_set1_epi32(0x7f800000);
+	const __m256 nan_val = _mm256_set1_ps(12.f);
+	const __m256 inf_val = _mm256_set1_ps(123.f);
+
+	int x = 0;
+
+	for(; x + 8 <= length; x += 8)
+	{
+		const __m256i l = _mm256_loadu_si256((const __m256i *)(pix + x));
+
+		const __m256 is_nan = _mm256_castsi256_ps( _mm256_cmpgt_epi32(_mm256_and_si256(l, abs_mask), inf) );
+		const __m256 is_inf = _mm256_castsi256_ps( _mm256_cmpeq_epi32(l, inf) );
+
+		__m256 p = _mm256_castsi256_ps(l);
+
+		p = _mm256_blendv_ps(p, nan_val, is_nan);
+		p = _mm256_blendv_ps(p, inf_val, is_inf);
+
+		_mm256_storeu_ps(pix + x, p);
+	}
+
+	KillNaNRow_Scalar(pix + x, length - x);
+}
+
+PROEXR_TARGET_AVX2 static void
+PixelStatsRow_AVX2(const float *pix, int length, PixelRowStats *stats)
+{
+	const __m256i abs_mask = _mm256_set1_epi32(0x7fffffff);
+	const __m256i inf = _mm256_set1_epi32(0x7f800000);
+	const __m256i neg_inf = _mm256_set1_epi32(0xff800000);
+	const __m256 pos_inf_val = _mm256_castsi256_ps(inf);
+	const __m256 neg_inf_val = _mm256_castsi256_ps(neg_inf);
+	const __m256 zero = _mm256_setzero_ps();
+
+	__m256i nans = _mm256_setzero_si256();
+	__m256i pos_infs = _mm256_setzero_si256();
+	__m256i neg_infs = _mm256_setzero_si256();
+	__m256i negatives = _mm256_setzero_si256();
+	__m256 min = pos_inf_val;
+	__m256 max = neg_inf_val;
+	__m256d sum_lo = _mm256_setzero_pd();
+	__m256d sum_hi = _mm256_setzero_pd();
+
+	int x = 0;
+
+	for(; x + 8 <= length; x += 8)
+	{
+		const __m256i l = _mm256_loadu_si256((const __m256i *)(pix + x));
+		const __m256i a = _mm256_and_si256(l, abs_mask);
+
+		const __m256 finite = _mm256_castsi256_ps( _mm256_cmpgt_epi32(inf, a) );
+
+		const __m256 p = _mm256_castsi256_ps(l);
+
+		nans = _mm256_sub_epi32(nans, _mm256_cmpgt_epi32(a, inf));
+		pos_infs = _mm256_sub_epi32(pos_infs, _mm256_cmpeq_epi32(l, inf));
+		neg_infs = _mm256_sub_epi32(neg_infs, _mm256_cmpeq_epi32(l, neg_inf));
+		negatives = _mm256_sub_epi32(negatives, _mm256_castps_si256( _mm256_and_ps(finite, _mm256_cmp_ps(p, zero, _CMP_LT_OQ)) ));
+
+		min = _mm256_min_ps(min, _mm256_blendv_ps(pos_inf_val, p, finite));
+		max = _mm256_max_ps(max, _mm256_blendv_ps(neg_inf_val, p, finite));
+
+		const __m256 s = _mm256_and_ps(finite, p);
+
+		sum_lo = _mm256_add_pd(sum_lo, _mm256_cvtps_pd(_mm256_castps256_ps128(s)));
+		sum_hi = _mm256_add_pd(sum_hi, _mm256_cvtps_pd(_mm256_extractf128_ps(s, 1)));
+	}
+
+	int counts[4][8];
+	float mins[8], maxes[8];
+	double sums[8];
+
+	_mm256_storeu_si256((__m256i *)counts[0], nans);
+	_mm256_storeu_si256((__m256i *)counts[1], pos_infs);
+	_mm256_storeu_si256((__m256i *)counts[2], neg_infs);
+	_mm256_storeu_si256((__m256i *)counts[3], negatives);
+	_mm256_storeu_ps(mins, min);
+	_mm256_storeu_ps(maxes, max);
+	_mm256_storeu_pd(sums + 0, sum_lo);
+	_mm256_storeu_pd(sums + 4, sum_hi);
+
+	for(int i=0; i < 8; i++)
+	{
+		stats->nans += counts[0][i];
+		stats->pos_infs += counts[1][i];
+		stats->neg_infs += counts[2][i];
+		stats->negatives += counts[3][i];
+
+		if(mins[i] < stats->min)
+			stats->min = mins[i];
+
+		if(maxes[i] > stats->max)
+			stats->max = maxes[i];
+
+		stats->sum += sums[i];
+	}
+
+	PixelStatsRow_Scalar(pix + x, length - x, stats);
+}
+
+// F16C rounds to nearest even just like half does; the only difference
+// is that signaling NaNs come out quiet
+PROEXR_TARGET_AVX2 static void
+FloatToHalfRow_F16C(const float *in, half *out, int length)
+{
+	int x = 0;
+
+	for(; x + 8 <= length; x += 8)
+	{
+		const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + x), 0); // 0 = _MM_FROUND_TO_NEAREST_INT
+
+		_mm_storeu_si128((__m128i *)(out + x), h);
+	}
+
+	FloatToHalfRow_Scalar(in + x, out + x, length - x);
+}
+
+PROEXR_TARGET_AVX2 static void
+HalfToFloatRow_F16C(const half *in, float *out, int length)
+{
+	int x = 0;
+
+	for(; x + 8 <= length; x += 8)
+	{
+		const __m128i h = _mm_loadu_si128((const __m128i *)(in + x));
+
+		_mm256_storeu_ps(out + x, _mm256_cvtph_ps(h));
+	}
+
+	HalfToFloatRow_Scalar(in + x, out + x, length - x);
+}
+
+// 8 pixels at a time: convert two pixels per vector, transpose within
+// the 128-bit lanes, and then put the evens and odds back in order
+PROEXR_TARGET_AVX2 static void
+SplitRgbaRow_F16C(const half *rgba, float *r, float *g, float *b, float *a, int length)
+{
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	
+	int x = 0;
+
+	for(; x + 8 <= length; x += 8)
+	{
+		const __m128i *in = (const __m128i *)(rgba + (x * 4));
+		
+		const __m256 p01 = _mm256_cvtph_ps(_mm_loadu_si128(in + 0));
+		const __m256 p23 = _mm256_cvtph_ps(_mm_loadu_si128(in + 1));
+		const __m256 p45 = _mm256_cvtph_ps(_mm_loadu_si128(in + 2));
+		const __m256 p67 = _mm256_cvtph_ps(_mm_loadu_si128(in + 3));
+		
+		const __m256 rg0 = _mm256_unpacklo_ps(p01, p23);
+		const __m256 ba0 = _mm256_unpackhi_ps(p01, p23);
+		const __m256 rg1 = _mm256_unpacklo_ps(p45, p67);
+		const __m256 ba1 = _mm256_unpackhi_ps(p45, p67);
+		
+		_mm256_storeu_ps(r + x, _mm256_permutevar8x32_ps(_mm256_shuffle_ps(rg0, rg1, _MM_SHUFFLE(1, 0, 1, 0)), order));
+		_mm256_storeu_ps(g + x, _mm256_permutevar8x32_ps(_mm256_shuffle_ps(rg0, rg1, _MM_SHUFFLE(3, 2, 3, 2)), order));
+		_mm256_storeu_ps(b + x, _mm256_permutevar8x32_ps(_mm256_shuffle_ps(ba0, ba1, _MM_SHUFFLE(1, 0, 1, 0)), order));
+		
+		if(a)
+			_mm256_storeu_ps(a + x, _mm256_permutevar8x32_ps(_mm256_shuffle_ps(ba0, ba1, _MM_SHUFFLE(3, 2, 3, 2)), order));
+	}
+
+	SplitRgbaRow_Scalar(rgba + (x * 4), r + x, g + x, b + x, (a ? a + x : NULL), length - x);
+}
+
+#endif // PROEXR_AVX2
+
+
+static bool
+HaveSSE2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+
+	return ((info[3] & (1 << 26)) != 0);
+#elif defined(__GNUC__)
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("sse2");
+#else
+	return false;
+#endif
+}
+
+static bool
+HaveAVX2()
+{
+#if !defined(PROEXR_AVX2)
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+
+	if(info[0] < 7)
+		return false;
+
+	__cpuid(info, 1);
+
+	const bool osxsave = ((info[2] & (1 << 27)) != 0);
+	const bool avx = ((info[2] & (1 << 28)) != 0);
+	const bool f16c = ((info[2] & (1 << 29)) != 0);
+
+	// the OS has to be saving the YMM registers too
+	if(!osxsave || !avx || !f16c || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+
+	return ((info[1] & (1 << 5)) != 0);
+#else
+	// every AVX2 chip has F16C, but we'll ask anyway
+	unsigned int eax, ebx, ecx, edx;
+
+	if( !__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & (1 << 29)) )
+		return false;
+
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // PROEXR_X86
+
+
+#pragma mark-
+
+
+#ifdef PROEXR_NEON
+
+static void
+PremultiplyRow_NEON(float *color, const float *alpha, int length)
+{
+	const float32x4_t one = vdupq_n_f32(1.f);
+
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const float32x4_t c = vld1q_f32(color + x);
+		const float32x4_t a = vld1q_f32(alpha + x);
+
+		const uint32x4_t mask = vcltq_f32(a, one);
+
+		vst1q_f32(color + x, vbslq_f32(mask, vmulq_f32(c, a), c));
+	}
+
+	PremultiplyRow_Scalar(color + x, alpha + x, length - x);
+}
+
+static void
+UnMultiplyRow_NEON(float *color, const float *alpha, int length)
+{
+	const float32x4_t zero = vdupq_n_f32(0.f);
+	const float32x4_t one = vdupq_n_f32(1.f);
+
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const float32x4_t c = vld1q_f32(color + x);
+		const float32x4_t a = vld1q_f32(alpha + x);
+
+		const uint32x4_t mask = vandq_u32(vcgtq_f32(a, zero), vcltq_f32(a, one));
+
+		vst1q_f32(color + x, vbslq_f32(mask, vdivq_f32(c, a), c));
+	}
+
+	UnMultiplyRow_Scalar(color + x, alpha + x, length - x);
+}
+
+static void
+AlphaClipRow_NEON(float *alpha, int length)
+{
+	const float32x4_t zero = vdupq_n_f32(0.f);
+	const float32x4_t one = vdupq_n_f32(1.f);
+
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		float32x4_t a = vld1q_f32(alpha + x);
+
+		a = vbslq_f32(vcltq_f32(a, zero), zero, a);
+		a = vbslq_f32(vcgtq_f32(a, one), one, a);
+
+		vst1q_f32(alpha + x, a);
+	}
+
+	AlphaClipRow_Scalar(alpha + x, length - x);
+}
+
+static void
+KillNaNRow_NEON(float *pix, int length)
+{
+	const uint32x4_t abs_mask = vdupq_n_u32(0x7fffffff);
+	const uint32x4_t inf = vdupq_n_u32(0x7f800000);
+	const float32x4_t nan_val = vdupq_n_f32(12.f);
+	const float32x4_t inf_val = vdupq_n_f32(123.f);
+
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const uint32x4_t l = vld1q_u32((const uint32_t *)(pix + x));
+
+		const uint32x4_t is_nan = vcgtq_u32(vandq_u32(l, abs_mask), inf);
+		const uint32x4_t is_inf = vceqq_u32(l, inf);
+
+		float32x4_t p = vreinterpretq_f32_u32(l);
+
+		p = vbslq_f32(is_nan, nan_val, p);
+		p = vbslq_f32(is_inf, inf_val, p);
+
+		vst1q_f32(pix + x, p);
+	}
+
+	KillNaNRow_Scalar(pix + x, length - x);
+}
+
+static void
+PixelStatsRow_NEON(const float *pix, int length, PixelRowStats *stats)
+{
+	const uint32x4_t abs_mask = vdupq_n_u32(0x7fffffff);
+	const uint32x4_t inf = vdupq_n_u32(0x7f800000);
+	const uint32x4_t neg_inf = vdupq_n_u32(0xff800000);
+	const float32x4_t pos_inf_val = vreinterpretq_f32_u32(inf);
+	const float32x4_t neg_inf_val = vreinterpretq_f32_u32(neg_inf);
+	const float32x4_t zero = vdupq_n_f32(0.f);
+
+	uint32x4_t nans = vdupq_n_u32(0);
+	uint32x4_t pos_infs = vdupq_n_u32(0);
+	uint32x4_t neg_infs = vdupq_n_u32(0);
+	uint32x4_t negatives = vdupq_n_u32(0);
+	float32x4_t min = pos_inf_val;
+	float32x4_t max = neg_inf_val;
+	float64x2_t sum_lo = vdupq_n_f64(0.0);
+	float64x2_t sum_hi = vdupq_n_f64(0.0);
+
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const uint32x4_t l = vld1q_u32((const uint32_t *)(pix + x));
+		const uint32x4_t a = vandq_u32(l, abs_mask);
+
+		const uint32x4_t finite = vcltq_u32(a, inf);
+
+		const float32x4_t p = vreinterpretq_f32_u32(l);
+
+		nans = vsubq_u32(nans, vcgtq_u32(a, inf));
+		pos_infs = vsubq_u32(pos_infs, vceqq_u32(l, inf));
+		neg_infs = vsubq_u32(neg_infs, vceqq_u32(l, neg_inf));
+		negatives = vsubq_u32(negatives, vandq_u32(finite, vcltq_f32(p, zero)));
+
+		min = vminq_f32(min, vbslq_f32(finite, p, pos_inf_val));
+		max = vmaxq_f32(max, vbslq_f32(finite, p, neg_inf_val));
+
+		const float32x4_t s = vreinterpretq_f32_u32( vandq_u32(finite, l) );
+
+		sum_lo = vaddq_f64(sum_lo, vcvt_f64_f32(vget_low_f32(s)));
+		sum_hi = vaddq_f64(sum_hi, vcvt_high_f64_f32(s));
+	}
+
+	stats->nans += vaddvq_u32(nans);
+	stats->pos_infs += vaddvq_u32(pos_infs);
+	stats->neg_infs += vaddvq_u32(neg_infs);
+	stats->negatives += vaddvq_u32(negatives);
+
+	if(vminvq_f32(min) < stats->min)
+		stats->min = vminvq_f32(min);
+
+	if(vmaxvq_f32(max) > stats->max)
+		stats->max = vmaxvq_f32(max);
+
+	stats->sum += vaddvq_f64( vaddq_f64(sum_lo, sum_hi) );
+
+	PixelStatsRow_Scalar(pix + x, length - x, stats);
+}
+
+static void
+FloatToHalfRow_NEON(const float *in, half *out, int length)
+{
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const float16x4_t h = vcvt_f16_f32(vld1q_f32(in + x));
+
+		vst1_u16((uint16_t *)(out + x), vreinterpret_u16_f16(h));
+	}
+
+	FloatToHalfRow_Scalar(in + x, out + x, length - x);
+}
+
+static void
+HalfToFloatRow_NEON(const half *in, float *out, int length)
+{
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const float16x4_t h = vreinterpret_f16_u16(vld1_u16((const uint16_t *)(in + x)));
+
+		vst1q_f32(out + x, vcvt_f32_f16(h));
+	}
+
+	HalfToFloatRow_Scalar(in + x, out + x, length - x);
+}
+
+static void
+SplitRgbaRow_NEON(const half *rgba, float *r, float *g, float *b, float *a, int length)
+{
+	int x = 0;
+
+	for(; x + 4 <= length; x += 4)
+	{
+		const uint16x4x4_t h = vld4_u16((const uint16_t *)(rgba + (x * 4))); // deinterleaves on the way in
+
+		vst1q_f32(r + x, vcvt_f32_f16(vreinterpret_f16_u16(h.val[0])));
+		vst1q_f32(g + x, vcvt_f32_f16(vreinterpret_f16_u16(h.val[1])));
+		vst1q_f32(b + x, vcvt_f32_f16(vreinterpret_f16_u16(h.val[2])));
+
+		if(a)
+			vst1q_f32(a + x, vcvt_f32_f16(vreinterpret_f16_u16(h.val[3])));
+	}
+
+	SplitRgbaRow_Scalar(rgba + (x * 4), r + x, g + x, b + x, (a ? a + x : NULL), length - x);
+}
+
+#endif // PROEXR_NEON
+
+
+#pragma mark-
+
+
+typedef struct PixelKernels {
+	const char *name;
+	void (*premultiply)(float *color, const float *alpha, int length);
+	void (*unMultiply)(float *color, const float *alpha, int length);
+	void (*alphaClip)(float *alpha, int length);
+	void (*killNaN)(float *pix, int length);
+	void (*pixelStats)(const float *pix, int length, PixelRowStats *stats);
+	void (*floatToHalf)(const float *in, half *out, int length);
+	void (*halfToFloat)(const half *in, float *out, int length);
+	void (*splitRgba)(const half *rgba, float *r, float *g, float *b, float *a, int length);
+} PixelKernels;
+
+
+static const PixelKernels gScalarKernels = { "scalar", PremultiplyRow_Scalar, UnMultiplyRow_Scalar, AlphaClipRow_Scalar, KillNaNRow_Scalar, PixelStatsRow_Scalar,
+												FloatToHalfRow_Scalar, HalfToFloatRow_Scalar, SplitRgbaRow_Scalar };
+
+#ifdef PROEXR_X86
+static const PixelKernels gSSE2Kernels = { "sse2", PremultiplyRow_SSE2, UnMultiplyRow_SSE2, AlphaClipRow_SSE2, KillNaNRow_SSE2, PixelStatsRow_SSE2,
+												FloatToHalfRow_Scalar, HalfToFloatRow_Scalar, SplitRgbaRow_Scalar };
+#endif
+
+#ifdef PROEXR_AVX2
+static const PixelKernels gAVX2Kernels = { "avx2", PremultiplyRow_AVX2, UnMultiplyRow_AVX2, AlphaClipRow_AVX2, KillNaNRow_AVX2, PixelStatsRow_AVX2,
+												FloatToHalfRow_F16C, HalfToFloatRow_F16C, SplitRgbaRow_F16C };
+#endif
+
+#ifdef PROEXR_NEON
+static const PixelKernels gNEONKernels = { "neon", PremultiplyRow_NEON, UnMultiplyRow_NEON, AlphaClipRow_NEON, KillNaNRow_NEON, PixelStatsRow_NEON,
+												FloatToHalfRow_NEON, HalfToFloatRow_NEON, SplitRgbaRow_NEON };
+#endif
+
+
+static const PixelKernels *
+ChooseKernels()
+{
+	const char *force = getenv("PROEXR_SIMD");
+
+	const PixelKernels *best = &gScalarKernels;
+
+#ifdef PROEXR_X86
+	if( HaveSSE2() )
+	{
+		best = &gSSE2Kernels;
+
+		if(force && !strcmp(force, "sse2"))
+			return best;
+	}
+#endif
+
+#ifdef PROEXR_AVX2
+	if( HaveAVX2() )
+	{
+		best = &gAVX2Kernels;
+	}
+#endif
+
+#ifdef PROEXR_NEON
+	best = &gNEONKernels;
+#endif
+
+	if(force && !strcmp(force, "scalar"))
+		return &gScalarKernels;
+
+	return best;
+}
+
+
+static const PixelKernels &
+Kernels()
+{
+	// if two threads race in here they'll both pick the same thing
+	static const PixelKernels *kernels = NULL;
+
+	if(kernels == NULL)
+		kernels = ChooseKernels();
+
+	return *kernels;
+}
+
+
+void
+PremultiplyRow(float *color, const float *alpha, int length)
+{
+	Kernels().premultiply(color, alpha, length);
+}
+
+void
+UnMultiplyRow(float *color, const float *alpha, int length)
+{
+	Kernels().unMultiply(color, alpha, length);
+}
+
+void
+AlphaClipRow(float *alpha, int length)
+{
+	Kernels().alphaClip(alpha, length);
+}
+
+void
+KillNaNRow(float *pix, int length)
+{
+	Kernels().killNaN(pix, length);
+}
+
+void
+PixelStatsRow(const float *pix, int length, PixelRowStats *stats)
+{
+	const float inf = std::numeric_limits<float>::infinity();
+	
+	stats->nans = stats->pos_infs = stats->neg_infs = stats->negatives = 0;
+	stats->min = inf;
+	stats->max = -inf;
+	stats->sum = 0.0;
+	
+	Kernels().pixelStats(pix, length, stats);
+}
+
+void
+FloatToHalfRow(const float *in, half *out, int length)
+{
+	Kernels().floatToHalf(in, out, length);
+}
+
+void
+HalfToFloatRow(const half *in, float *out, int length)
+{
+	Kernels().halfToFloat(in, out, length);
+}
+
+void
+SplitRgbaRow(const half *rgba, float *r, float *g, float *b, float *a, int length)
+{
+	Kernels().splitRgba(rgba, r, g, b, a, length);
+}
+
+const char *
+PixelKernelsName()
+{
+	return Kernels().name;
+}
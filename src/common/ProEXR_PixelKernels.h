@@ -0,0 +1,70 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+
+#ifndef PROEXR_PIXELKERNELS_H
+#define PROEXR_PIXELKERNELS_H
+
+#include <half.h>
+
+// Row kernels for the float pixel passes.  SSE2, AVX2 or NEON versions
+// are picked at runtime and give the same bits as the plain C loops:
+//
+//   PremultiplyRow:  color *= alpha, only where alpha < 1
+//   UnMultiplyRow:   color /= alpha, only where 0 < alpha < 1
+//   AlphaClipRow:    alpha clamped to [0, 1], NaN left alone
+//   KillNaNRow:      NaN becomes 12, +inf becomes 123 (same as KillNaN())
+//
+// plus batched float<->half conversion (F16C or NEON, else half's tables),
+// SplitRgbaRow, which takes interleaved Rgba halfs apart into floats, and
+// PixelStatsRow, which sizes up a row before KillNaNRow gets to it.  The
+// vector versions of that add up the sum in a different order, so only
+// the counts, min and max are guaranteed to match.
+//
+// Set PROEXR_SIMD=scalar (or sse2) in the environment to force a
+// slower version when comparing results.
+
+void PremultiplyRow(float *color, const float *alpha, int length);
+void UnMultiplyRow(float *color, const float *alpha, int length);
+void AlphaClipRow(float *alpha, int length);
+void KillNaNRow(float *pix, int length);
+
+typedef struct PixelRowStats {
+	int nans;
+	int pos_infs;
+	int neg_infs;
+	int negatives; // finite pixels below 0
+	float min; // of the finite pixels, +inf if there weren't any
+	float max; // -inf if there weren't any
+	double sum;
+} PixelRowStats;
+
+void PixelStatsRow(const float *pix, int length, PixelRowStats *stats); // fills in stats
+
+void FloatToHalfRow(const float *in, half *out, int length);
+void HalfToFloatRow(const half *in, float *out, int length);
+void SplitRgbaRow(const half *rgba, float *r, float *g, float *b, float *a, int length); // a can be NULL
+
+const char *PixelKernelsName();
+
+
+#endif // PROEXR_PIXELKERNELS_H
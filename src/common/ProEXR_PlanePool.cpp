@@ -0,0 +1,220 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+
+#include "ProEXR_PlanePool.h"
+
+#include <IlmThreadMutex.h>
+
+#include <map>
+#include <vector>
+#include <new>
+
+#include <string.h>
+#include <assert.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+using namespace IlmThread;
+using namespace std;
+
+
+static void *
+OSAllocate(size_t size)
+{
+#ifdef WIN32
+	return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void *plane = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	
+	return (plane == MAP_FAILED ? NULL : plane);
+#endif
+}
+
+static void
+OSFree(void *plane, size_t size)
+{
+#ifdef WIN32
+	VirtualFree(plane, 0, MEM_RELEASE);
+#else
+	munmap(plane, size);
+#endif
+}
+
+
+typedef map< size_t, vector<void *> > PlaneMap;
+
+class PlanePool
+{
+  public:
+	PlanePool() : _limit(0), _pooled(0) {}
+	~PlanePool() { release(); }
+	
+	void *get(size_t size); // NULL if there's nothing that size
+	bool put(void *plane, size_t size); // false if it didn't fit
+	
+	void setLimit(size_t bytes);
+	void release();
+	
+  private:
+	void trim(); // assumes we have the lock
+	
+	Mutex _mutex;
+	PlaneMap _planes;
+	size_t _limit;
+	size_t _pooled;
+};
+
+void *
+PlanePool::get(size_t size)
+{
+	Lock lock(_mutex);
+	
+	PlaneMap::iterator found = _planes.find(size);
+	
+	if(found == _planes.end() || found->second.empty())
+		return NULL;
+	
+	void *plane = found->second.back();
+	
+	found->second.pop_back();
+	
+	_pooled -= size;
+	
+	return plane;
+}
+
+bool
+PlanePool::put(void *plane, size_t size)
+{
+	Lock lock(_mutex);
+	
+	if(_pooled + size > _limit)
+		return false;
+	
+	_planes[size].push_back(plane);
+	
+	_pooled += size;
+	
+	return true;
+}
+
+void
+PlanePool::setLimit(size_t bytes)
+{
+	Lock lock(_mutex);
+	
+	_limit = bytes;
+	
+	trim();
+}
+
+void
+PlanePool::release()
+{
+	Lock lock(_mutex);
+	
+	const size_t limit = _limit;
+	
+	_limit = 0;
+	
+	trim();
+	
+	_limit = limit;
+}
+
+void
+PlanePool::trim()
+{
+	PlaneMap::iterator i = _planes.begin();
+	
+	while(_pooled > _limit && i != _planes.end())
+	{
+		while(_pooled > _limit && !i->second.empty())
+		{
+			OSFree(i->second.back(), i->first);
+			
+			i->second.pop_back();
+			
+			_pooled -= i->first;
+		}
+		
+		++i;
+	}
+}
+
+
+static PlanePool gPlanePool;
+
+
+void *
+AllocatePlane(size_t size, bool zero_fill)
+{
+	if(size == 0)
+		return NULL;
+	
+	void *plane = gPlanePool.get(size);
+	
+	if(plane)
+	{
+		if(zero_fill)
+			memset(plane, 0, size);
+	}
+	else
+	{
+		plane = OSAllocate(size); // already zeroed
+		
+		if(plane == NULL)
+			throw bad_alloc();
+	}
+	
+	return plane;
+}
+
+void
+FreePlane(void *plane, size_t size)
+{
+	if(plane == NULL)
+		return;
+	
+	assert(size > 0);
+	
+	if( !gPlanePool.put(plane, size) )
+		OSFree(plane, size);
+}
+
+void
+SetPlanePoolLimit(size_t bytes)
+{
+	gPlanePool.setLimit(bytes);
+}
+
+void
+ReleasePooledPlanes()
+{
+	gPlanePool.release();
+}
@@ -0,0 +1,48 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+
+
+#ifndef PROEXR_PLANEPOOL_H
+#define PROEXR_PLANEPOOL_H
+
+#include <stddef.h>
+
+// Page-aligned memory for channel planes.  New planes come straight from
+// the OS (mmap or VirtualAlloc), so they're already zero and don't get
+// touched until somebody writes to them.  Freed planes can be kept in a
+// pool and handed back out for the next request of the same size, which
+// is what happens over and over when converting a sequence of frames.
+//
+// Pooled planes are only cleared if you ask for zero_fill, so skip that
+// when the whole plane is about to be overwritten anyway.
+
+void *AllocatePlane(size_t size, bool zero_fill=true); // throws bad_alloc
+void FreePlane(void *plane, size_t size);
+
+// how much freed memory to hang onto, default is 0 (pool nothing), which
+// is what the plug-ins want so they're not sitting on memory the host could use
+void SetPlanePoolLimit(size_t bytes);
+void ReleasePooledPlanes();
+
+
+#endif // PROEXR_PLANEPOOL_H
@@ -0,0 +1,365 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+
+#include "ProEXR_ReadAheadIStream.h"
+
+#include "ProEXR_PlanePool.h"
+
+#include <ImfVersion.h>
+#include <Iex.h>
+
+#include <IlmThread.h>
+
+#include <string.h>
+
+
+using namespace Imf;
+using namespace Iex;
+using namespace IlmThread;
+using namespace std;
+
+
+// 8 x 4 MB keeps a few chunks of even a wide file in flight,
+// and is still small next to the pixels being read
+static const int kReadAheadBlocks = 8;
+static const size_t kReadAheadBlockSize = (4 * 1024 * 1024);
+
+
+// A single-part scanline file has its chunks one after another, so reading
+// ahead pays off.  Tiled and multi-part files hop between regions, and every
+// hop outside the window would toss the blocks in flight.
+static bool
+ReadsInOrder(IStream &source, Int64 size)
+{
+	if(size < 8)
+		return true; // not an EXR file anyway
+
+	const Int64 pos = source.tellg();
+
+	char start[8];
+
+	source.seekg(0);
+	source.read(start, 8);
+	source.seekg(pos);
+
+	if( !isImfMagic(start) )
+		return true;
+
+	const int version = ((unsigned char)start[4] << 0) |
+						((unsigned char)start[5] << 8) |
+						((unsigned char)start[6] << 16) |
+						((unsigned char)start[7] << 24);
+
+	return !isTiled(version) && !isMultiPart(version);
+}
+
+
+class ReadAheadIStream::FetchThread : public Thread
+{
+  public:
+	FetchThread(ReadAheadIStream &stream) : _stream(stream) { start(); }
+	virtual ~FetchThread() {} // Thread's destructor waits for run() to return
+
+	virtual void run() { _stream.fetchLoop(); }
+
+  private:
+	ReadAheadIStream &_stream;
+};
+
+
+ReadAheadIStream::ReadAheadIStream(IStream &source, Int64 size, int blocks, size_t block_size) :
+	IStream( source.fileName() ),
+	_source(source),
+	_size(size),
+	_block_size(block_size > 0 ? block_size : kReadAheadBlockSize),
+	_pos( source.tellg() ),
+	_source_pos( source.tellg() ),
+	_first(0),
+	_next(0),
+	_generation(0),
+	_error_block(-1),
+	_stop(false),
+	_fetcher_waiting(false),
+	_reader_waiting(false),
+	_thread(NULL)
+{
+	if(size < 0)
+		throw ArgExc("Bad read-ahead file size.");
+
+	if( supportsThreads() && ReadsInOrder(source, size) )
+	{
+		// no point holding more blocks than the file has
+		const Int64 file_blocks = (_size + _block_size - 1) / _block_size;
+
+		const int count = (blocks > 0 ? blocks : kReadAheadBlocks);
+
+		_slots.resize( (file_blocks < count ? (file_blocks > 1 ? file_blocks : 1) : count), NULL );
+
+		try
+		{
+			for(int i=0; i < _slots.size(); i++)
+				_slots[i] = (char *)AllocatePlane(_block_size, false);
+		}
+		catch(...)
+		{
+			for(int i=0; i < _slots.size(); i++)
+			{
+				if(_slots[i] != NULL)
+					FreePlane(_slots[i], _block_size);
+			}
+
+			throw;
+		}
+
+		_first = _next = (_pos / _block_size);
+
+		_thread = new FetchThread(*this);
+	}
+}
+
+
+ReadAheadIStream::~ReadAheadIStream()
+{
+	if(_thread)
+	{
+		{
+			Lock lock(_mutex);
+
+			_stop = true;
+
+			wakeFetcher();
+		}
+
+		delete _thread;
+	}
+
+	for(int i=0; i < _slots.size(); i++)
+		FreePlane(_slots[i], _block_size);
+}
+
+
+bool
+ReadAheadIStream::read(char c[/*n*/], int n)
+{
+	if(n < 0 || _pos + n > _size)
+		throw InputExc("Unexpected end of file.");
+
+	if(_thread == NULL)
+	{
+		if(_source_pos != _pos)
+			_source.seekg(_pos);
+
+		_source.read(c, n);
+
+		_pos = _source_pos = _pos + n;
+
+		return true;
+	}
+
+	while(n > 0)
+	{
+		const Int64 block = _pos / _block_size;
+		const size_t offset = _pos - (block * _block_size);
+		const int piece = (n < _block_size - offset ? n : _block_size - offset);
+
+		{
+			Lock lock(_mutex);
+
+			if(block < _first || block >= _first + (Int64)_slots.size() ||
+				(_error_block >= 0 && block > _error_block))
+			{
+				// a block we skipped over failing is no reason to give up,
+				// but the fetcher stopped there, so start it again from here
+				restart(block);
+			}
+			else if(block > _first)
+			{
+				// done with the ones behind us, so the fetcher can reuse them
+				_first = block;
+
+				wakeFetcher();
+			}
+
+			while(block >= _next && block != _error_block)
+			{
+				_reader_waiting = true;
+
+				lock.release();
+
+				_read_wake.wait();
+
+				lock.acquire();
+			}
+
+			if(block == _error_block)
+				throw InputExc(_error);
+		}
+
+		// the fetcher stays out of _first's slot, so no lock while copying
+		memcpy(c, slot(block) + offset, piece);
+
+		c += piece;
+		n -= piece;
+		_pos += piece;
+	}
+
+	return true;
+}
+
+
+Int64
+ReadAheadIStream::tellg()
+{
+	return _pos;
+}
+
+
+void
+ReadAheadIStream::seekg(Int64 pos)
+{
+	// read() starts over if this takes us out of the blocks we have
+	_pos = pos;
+}
+
+
+void
+ReadAheadIStream::restart(Int64 block)
+{
+	// call with _mutex locked
+	_first = _next = block;
+
+	_generation++; // whatever the fetcher is in the middle of gets tossed
+
+	_error_block = -1;
+	_error.clear();
+
+	wakeFetcher();
+}
+
+
+void
+ReadAheadIStream::wakeFetcher()
+{
+	// call with _mutex locked
+	if(_fetcher_waiting)
+	{
+		_fetcher_waiting = false;
+
+		_fetch_wake.post();
+	}
+}
+
+
+void
+ReadAheadIStream::fetchLoop()
+{
+	Lock lock(_mutex);
+
+	while(true)
+	{
+		while(!_stop)
+		{
+			if(_error_block >= 0 && _error_block < _first)
+			{
+				// the reader went on past the block that failed
+				_next = _first;
+
+				_error_block = -1;
+				_error.clear();
+			}
+
+			if(_error_block < 0 &&
+				_next < _first + (Int64)_slots.size() &&
+				_next * (Int64)_block_size < _size)
+			{
+				break;
+			}
+
+			_fetcher_waiting = true;
+
+			lock.release();
+
+			_fetch_wake.wait();
+
+			lock.acquire();
+		}
+
+		if(_stop)
+			return;
+
+		const Int64 block = _next;
+		const int generation = _generation;
+
+		const Int64 start = block * _block_size;
+		const int length = (_size - start < _block_size ? _size - start : _block_size);
+
+		char *dest = slot(block);
+
+		lock.release();
+
+		string error;
+
+		try
+		{
+			if(_source_pos != start)
+				_source.seekg(start);
+
+			_source_pos = -1; // in case the read throws
+
+			_source.read(dest, length);
+
+			_source_pos = start + length;
+		}
+		catch(const std::exception &e)
+		{
+			error = e.what();
+		}
+		catch(...)
+		{
+			error = "Error reading file.";
+		}
+
+		lock.acquire();
+
+		if(generation == _generation)
+		{
+			if( error.empty() )
+			{
+				_next++;
+			}
+			else
+			{
+				// the reader finds out when it gets here, until then we stop
+				_error_block = block;
+				_error = error;
+			}
+
+			if(_reader_waiting)
+			{
+				_reader_waiting = false;
+
+				_read_wake.post();
+			}
+		}
+	}
+}
@@ -0,0 +1,94 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+
+
+#ifndef PROEXR_READAHEADISTREAM_H
+#define PROEXR_READAHEADISTREAM_H
+
+#include <ImfIO.h>
+
+#include <IlmThreadMutex.h>
+#include <IlmThreadSemaphore.h>
+
+#include <string>
+#include <vector>
+
+// Wraps another Imf::IStream and keeps a thread reading the blocks after
+// wherever OpenEXR is reading, so a file on a network share comes in at
+// the speed of the link instead of one round trip per chunk.  Scanline
+// chunks of a single-part file are stored in the order they get read, so
+// plain read-ahead is all it takes; a seek outside the blocks in memory
+// starts over from there.
+//
+// It doesn't look at the chunk offset tables, so tiled and multi-part
+// files, whose reads jump around, aren't helped.  For those (and without
+// thread support) reads just go straight through.
+//
+// The source stream belongs to the read-ahead thread from here on, so
+// don't touch it yourself until this is gone.
+
+class ReadAheadIStream : public Imf::IStream
+{
+  public:
+	ReadAheadIStream(Imf::IStream &source, Imf::Int64 size, // size of the file
+						int blocks=0, size_t block_size=0); // 0 for the defaults
+	virtual ~ReadAheadIStream();
+
+	virtual bool read(char c[/*n*/], int n);
+	virtual Imf::Int64 tellg();
+	virtual void seekg(Imf::Int64 pos);
+
+  private:
+	class FetchThread;
+
+	void fetchLoop();
+	void restart(Imf::Int64 block); // _mutex is locked
+	void wakeFetcher(); // _mutex is locked
+
+	char *slot(Imf::Int64 block) const { return _slots[block % _slots.size()]; }
+
+	Imf::IStream &_source;
+	const Imf::Int64 _size;
+	size_t _block_size;
+	std::vector<char *> _slots;
+
+	Imf::Int64 _pos; // where the reader is
+	Imf::Int64 _source_pos; // where the source is, for the fetcher, -1 if unknown
+
+	IlmThread::Mutex _mutex;
+	Imf::Int64 _first; // oldest block we're holding on to
+	Imf::Int64 _next; // next block to fetch, everything from _first up to here is ready
+	int _generation; // goes up when we start over somewhere else
+	Imf::Int64 _error_block; // block the source choked on, -1 if none
+	std::string _error;
+	bool _stop;
+
+	IlmThread::Semaphore _fetch_wake;
+	IlmThread::Semaphore _read_wake;
+	bool _fetcher_waiting;
+	bool _reader_waiting;
+
+	FetchThread *_thread;
+};
+
+#endif // PROEXR_READAHEADISTREAM_H
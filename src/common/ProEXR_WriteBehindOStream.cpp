@@ -0,0 +1,377 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+
+#include "ProEXR_WriteBehindOStream.h"
+
+#include "ProEXR_PlanePool.h"
+
+#include <Iex.h>
+
+#include <IlmThread.h>
+
+#include <string.h>
+
+
+using namespace Imf;
+using namespace Iex;
+using namespace IlmThread;
+using namespace std;
+
+
+// a frame's worth of compressed chunks can be in flight
+// while the share catches up
+static const int kWriteBehindBuffers = 4;
+static const size_t kWriteBehindBufferSize = (4 * 1024 * 1024);
+
+
+class WriteBehindOStream::FlushThread : public Thread
+{
+  public:
+	FlushThread(WriteBehindOStream &stream) : _stream(stream) { start(); }
+	virtual ~FlushThread() {} // Thread's destructor waits for run() to return
+
+	virtual void run() { _stream.flushLoop(); }
+
+  private:
+	WriteBehindOStream &_stream;
+};
+
+
+WriteBehindOStream::WriteBehindOStream(OStream &dest, int buffers, size_t buffer_size) :
+	OStream( dest.fileName() ),
+	_dest(dest),
+	_buffer_size(buffer_size > 0 ? buffer_size : kWriteBehindBufferSize),
+	_max_buffers(buffers > 0 ? buffers : kWriteBehindBuffers),
+	_cursor(0),
+	_capacity(0),
+	_dest_pos( dest.tellp() ),
+	_writing(false),
+	_failed(false),
+	_stop(false),
+	_flusher_waiting(false),
+	_writer_waiting(false),
+	_thread(NULL)
+{
+	_current.data = NULL;
+	_current.start = _dest_pos;
+	_current.length = 0;
+
+	// buffers only get allocated as they're needed, so a small file only takes one
+	if( supportsThreads() )
+		_thread = new FlushThread(*this);
+}
+
+
+WriteBehindOStream::~WriteBehindOStream()
+{
+	try
+	{
+		queueCurrent();
+	}
+	catch(...) {} // flush() is where errors get reported
+
+	if(_thread)
+	{
+		{
+			Lock lock(_mutex);
+
+			_stop = true; // the flush thread empties the queue first
+
+			if(_flusher_waiting)
+			{
+				_flusher_waiting = false;
+
+				_flush_wake.post();
+			}
+		}
+
+		delete _thread;
+	}
+
+	for(int i=0; i < _buffers.size(); i++)
+		FreePlane(_buffers[i], _buffer_size);
+}
+
+
+void
+WriteBehindOStream::write(const char c[/*n*/], int n)
+{
+	while(n > 0)
+	{
+		if(_current.data == NULL || _cursor == _capacity)
+		{
+			const Int64 pos = tellp();
+
+			queueCurrent();
+
+			startBuffer(pos);
+		}
+
+		const int piece = (n < _capacity - _cursor ? n : _capacity - _cursor);
+
+		memcpy(_current.data + _cursor, c, piece);
+
+		_cursor += piece;
+
+		if(_current.length < _cursor)
+			_current.length = _cursor;
+
+		c += piece;
+		n -= piece;
+	}
+}
+
+
+Int64
+WriteBehindOStream::tellp()
+{
+	return _current.start + _cursor;
+}
+
+
+void
+WriteBehindOStream::seekp(Int64 pos)
+{
+	if(_current.data != NULL && pos >= _current.start && pos <= _current.start + (Int64)_current.length)
+	{
+		// still in the buffer we're filling
+		_cursor = pos - _current.start;
+	}
+	else
+	{
+		queueCurrent();
+
+		// the next write starts a buffer here
+		_current.start = pos;
+		_current.length = 0;
+		_cursor = 0;
+	}
+}
+
+
+void
+WriteBehindOStream::flush()
+{
+	const Int64 pos = tellp();
+
+	queueCurrent();
+
+	_current.start = pos;
+	_current.length = 0;
+	_cursor = 0;
+
+	Lock lock(_mutex);
+
+	while(!_queue.empty() || _writing)
+	{
+		_writer_waiting = true;
+
+		lock.release();
+
+		_write_wake.wait();
+
+		lock.acquire();
+	}
+
+	if(_failed)
+		throw IoExc(_error);
+}
+
+
+void
+WriteBehindOStream::queueCurrent()
+{
+	if(_current.data == NULL)
+		return;
+
+	const Buffer buf = _current;
+
+	_current.data = NULL; // start and _cursor still say where we are
+
+	if(_thread && buf.length > 0)
+	{
+		Lock lock(_mutex);
+
+		_queue.push_back(buf);
+
+		if(_flusher_waiting)
+		{
+			_flusher_waiting = false;
+
+			_flush_wake.post();
+		}
+	}
+	else
+	{
+		try
+		{
+			if(buf.length > 0)
+				writeBuffer(buf);
+		}
+		catch(...)
+		{
+			Lock lock(_mutex);
+
+			_free.push_back(buf.data);
+
+			throw;
+		}
+
+		Lock lock(_mutex);
+
+		_free.push_back(buf.data);
+	}
+}
+
+
+void
+WriteBehindOStream::startBuffer(Int64 pos)
+{
+	Lock lock(_mutex);
+
+	while(_free.empty() && _buffers.size() >= _max_buffers && !_failed)
+	{
+		_writer_waiting = true;
+
+		lock.release();
+
+		_write_wake.wait();
+
+		lock.acquire();
+	}
+
+	if(_failed)
+		throw IoExc(_error);
+
+	if( _free.empty() )
+	{
+		char *data = (char *)AllocatePlane(_buffer_size, false);
+
+		_buffers.push_back(data);
+		_free.push_back(data);
+	}
+
+	_current.data = _free.back();
+	_current.start = pos;
+	_current.length = 0;
+
+	_free.pop_back();
+
+	_cursor = 0;
+
+	// stop short so the buffers after this one line up
+	_capacity = _buffer_size - (size_t)(pos % _buffer_size);
+}
+
+
+void
+WriteBehindOStream::writeBuffer(const Buffer &buf)
+{
+	if(_dest_pos != buf.start)
+		_dest.seekp(buf.start);
+
+	_dest_pos = -1; // in case the write throws
+
+	_dest.write(buf.data, buf.length);
+
+	_dest_pos = buf.start + buf.length;
+}
+
+
+void
+WriteBehindOStream::wakeWriter()
+{
+	// call with _mutex locked
+	if(_writer_waiting)
+	{
+		_writer_waiting = false;
+
+		_write_wake.post();
+	}
+}
+
+
+void
+WriteBehindOStream::flushLoop()
+{
+	Lock lock(_mutex);
+
+	while(true)
+	{
+		while(!_stop && _queue.empty())
+		{
+			_flusher_waiting = true;
+
+			lock.release();
+
+			_flush_wake.wait();
+
+			lock.acquire();
+		}
+
+		if( _queue.empty() )
+			return; // stopping, and everything is written
+
+		const Buffer buf = _queue.front();
+
+		_queue.pop_front();
+
+		_writing = true;
+
+		const bool failed = _failed;
+
+		lock.release();
+
+		string error;
+
+		if(!failed) // after one fails, the rest are just thrown away
+		{
+			try
+			{
+				writeBuffer(buf);
+			}
+			catch(const std::exception &e)
+			{
+				error = e.what();
+			}
+			catch(...)
+			{
+				error = "Not able to write.";
+			}
+		}
+
+		lock.acquire();
+
+		if(!error.empty() && !_failed)
+		{
+			_failed = true;
+			_error = error;
+		}
+
+		_free.push_back(buf.data);
+
+		_writing = false;
+
+		wakeWriter();
+	}
+}
@@ -0,0 +1,102 @@
+/* ---------------------------------------------------------------------
+//
+// ProEXR - OpenEXR plug-ins for Photoshop and After Effects
+// Copyright (c) 2007-2017,  Brendan Bolles, http://www.fnordware.com
+//
+// This file is part of ProEXR.
+//
+// ProEXR is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -------------------------------------------------------------------*/
+
+
+
+#ifndef PROEXR_WRITEBEHINDOSTREAM_H
+#define PROEXR_WRITEBEHINDOSTREAM_H
+
+#include <ImfIO.h>
+
+#include <IlmThreadMutex.h>
+#include <IlmThreadSemaphore.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+
+// Wraps another Imf::OStream, collecting OpenEXR's many small writes into
+// big page-aligned buffers that a thread hands to the destination while
+// compression carries on.  After the first one, buffers end on multiples
+// of the buffer size, so a network share sees a few large sequential
+// writes.  Seeking back to patch the offset table just starts a new buffer
+// there; buffers are written in order, so the patch lands on top.
+//
+// The destination belongs to the flush thread until this is gone.  Call
+// flush() when the file is done: write errors come out of there (or the
+// next write), since the destructor can't throw them.
+
+class WriteBehindOStream : public Imf::OStream
+{
+  public:
+	WriteBehindOStream(Imf::OStream &dest, int buffers=0, size_t buffer_size=0); // 0 for the defaults
+	virtual ~WriteBehindOStream();
+
+	virtual void write(const char c[/*n*/], int n);
+	virtual Imf::Int64 tellp();
+	virtual void seekp(Imf::Int64 pos);
+
+	void flush(); // waits until everything is in the destination, throws if it didn't make it
+
+  private:
+	typedef struct Buffer {
+		char *data;
+		Imf::Int64 start; // where it goes in the file
+		size_t length;
+	} Buffer;
+
+	class FlushThread;
+
+	void flushLoop();
+	void queueCurrent();
+	void startBuffer(Imf::Int64 pos);
+	void writeBuffer(const Buffer &buf);
+	void wakeWriter(); // _mutex is locked
+
+	Imf::OStream &_dest;
+	const size_t _buffer_size;
+	const int _max_buffers;
+
+	Buffer _current; // the one write() is filling
+	size_t _cursor;
+	size_t _capacity; // short of _buffer_size if that gets the next one aligned
+
+	Imf::Int64 _dest_pos; // where the destination is, for whoever writes to it, -1 if unknown
+
+	IlmThread::Mutex _mutex;
+	std::vector<char *> _buffers; // every one we've allocated
+	std::vector<char *> _free;
+	std::deque<Buffer> _queue;
+	bool _writing; // flush thread has one out of the queue
+	bool _failed;
+	std::string _error;
+	bool _stop;
+
+	IlmThread::Semaphore _flush_wake;
+	IlmThread::Semaphore _write_wake;
+	bool _flusher_waiting;
+	bool _writer_waiting;
+
+	FlushThread *_thread;
+};
+
+#endif // PROEXR_WRITEBEHINDOSTREAM_H
@@ -23,6 +23,16 @@
 
 #include "ProEXRdoc.h"
 
+#include "ProEXR_PixelKernels.h"
+#include "ProEXR_ParallelFor.h"
+#include "ProEXR_PlanePool.h"
+
+#include <sstream>
+#include <algorithm>
+#include <limits>
+
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include <Iex.h>
@@ -32,6 +42,8 @@
 
 #include <ImfStandardAttributes.h>
 #include <ImfTileDescriptionAttribute.h>
+#include <ImfThreading.h>
+#include <ImfTiledOutputFile.h>
 #include <ImfArray.h>
 
 
@@ -42,223 +54,738 @@ using namespace IlmThread;
 using namespace std;
 
 
-class PremultiplyRowTask : public Task
+// Float rows for the kernels.  FLOAT buffers are worked on in place, HALF
+// buffers (see ProEXRdoc::halfStorage()) get converted into the scratch row
+// and have to be put back with StoreFloatRow() afterwards.
+static inline float *
+LoadFloatRow(const ProEXRbuffer &desc, int y, float *scratch)
+{
+	char *row = (char *)desc.buf + (desc.rowbytes * y);
+	
+	if(desc.type == Imf::HALF)
+	{
+		HalfToFloatRow((const half *)row, scratch, desc.width);
+		
+		return scratch;
+	}
+	else
+		return (float *)row;
+}
+
+static inline void
+StoreFloatRow(const ProEXRbuffer &desc, int y, const float *pix)
+{
+	if(desc.type == Imf::HALF)
+		FloatToHalfRow(pix, (half *)((char *)desc.buf + (desc.rowbytes * y)), desc.width);
+}
+
+// LoadFloatRow() only uses the scratch row for HALF buffers,
+// so FLOAT ones don't have to allocate anything
+static inline void
+SizeScratchRow(Array<float> &scratch, const ProEXRbuffer &desc)
+{
+	if(desc.type == Imf::HALF)
+		scratch.resizeErase(desc.width);
+}
+
+
+class PremultiplyRows : public ParallelRowKernel
 {
   public:
-	PremultiplyRowTask(TaskGroup *group, float *color_row, float *alpha_row, int length);
-	virtual ~PremultiplyRowTask() {}
+	PremultiplyRows(const ProEXRbuffer &color, const ProEXRbuffer &alpha);
+	virtual ~PremultiplyRows() {}
 	
-	virtual void execute();
+	virtual void processRows(int y_start, int y_end);
 
   private:
-	float *_color_row;
-	float *_alpha_row;
-	int _length;
+	const ProEXRbuffer _color;
+	const ProEXRbuffer _alpha;
 };
 
-PremultiplyRowTask::PremultiplyRowTask(TaskGroup *group, float *color_row, float *alpha_row, int length) :
-	Task(group),
-	_color_row(color_row),
-	_alpha_row(alpha_row),
-	_length(length)
+PremultiplyRows::PremultiplyRows(const ProEXRbuffer &color, const ProEXRbuffer &alpha) :
+	_color(color),
+	_alpha(alpha)
+{
+	assert(_color.width == _alpha.width);
+}
+
+void
+PremultiplyRows::processRows(int y_start, int y_end)
+{
+	Array<float> color_scratch, alpha_scratch;
+	
+	SizeScratchRow(color_scratch, _color);
+	SizeScratchRow(alpha_scratch, _alpha);
+	
+	for(int y = y_start; y < y_end; y++)
+	{
+		float *color = LoadFloatRow(_color, y, color_scratch);
+		
+		PremultiplyRow(color, LoadFloatRow(_alpha, y, alpha_scratch), _color.width);
+		
+		StoreFloatRow(_color, y, color);
+	}
+}
+
+
+class UnMultiplyRows : public ParallelRowKernel
 {
+  public:
+	UnMultiplyRows(const ProEXRbuffer &color, const ProEXRbuffer &alpha);
+	virtual ~UnMultiplyRows() {}
+	
+	virtual void processRows(int y_start, int y_end);
+
+  private:
+	const ProEXRbuffer _color;
+	const ProEXRbuffer _alpha;
+};
 
+UnMultiplyRows::UnMultiplyRows(const ProEXRbuffer &color, const ProEXRbuffer &alpha) :
+	_color(color),
+	_alpha(alpha)
+{
+	assert(_color.width == _alpha.width);
 }
 
 void
-PremultiplyRowTask::execute()
+UnMultiplyRows::processRows(int y_start, int y_end)
 {
-	float *color = _color_row;
-	float *alpha = _alpha_row;
+	Array<float> color_scratch, alpha_scratch;
+	
+	SizeScratchRow(color_scratch, _color);
+	SizeScratchRow(alpha_scratch, _alpha);
 	
-	for(int x=0; x < _length; x++)
+	for(int y = y_start; y < y_end; y++)
 	{
-		if(*alpha < 1.f)
-			*color *= *alpha;
+		float *color = LoadFloatRow(_color, y, color_scratch);
 		
-		color++;
-		alpha++;
+		UnMultiplyRow(color, LoadFloatRow(_alpha, y, alpha_scratch), _color.width);
+		
+		StoreFloatRow(_color, y, color);
 	}
 }
 
 
-class UnMultiplyRowTask : public Task
+class AlphaClipRows : public ParallelRowKernel
 {
   public:
-	UnMultiplyRowTask(TaskGroup *group, float *color_row, float *alpha_row, int length);
-	virtual ~UnMultiplyRowTask() {}
+	AlphaClipRows(const ProEXRbuffer &alpha);
+	virtual ~AlphaClipRows() {}
 	
-	virtual void execute();
+	virtual void processRows(int y_start, int y_end);
 
   private:
-	float *_color_row;
-	float *_alpha_row;
-	int _length;
+	const ProEXRbuffer _alpha;
 };
 
-UnMultiplyRowTask::UnMultiplyRowTask(TaskGroup *group, float *color_row, float *alpha_row, int length) :
-	Task(group),
-	_color_row(color_row),
-	_alpha_row(alpha_row),
-	_length(length)
+AlphaClipRows::AlphaClipRows(const ProEXRbuffer &alpha) :
+	_alpha(alpha)
 {
 
 }
 
 void
-UnMultiplyRowTask::execute()
+AlphaClipRows::processRows(int y_start, int y_end)
+{
+	Array<float> scratch;
+	
+	SizeScratchRow(scratch, _alpha);
+	
+	for(int y = y_start; y < y_end; y++)
+	{
+		float *alpha = LoadFloatRow(_alpha, y, scratch);
+		
+		AlphaClipRow(alpha, _alpha.width);
+		
+		StoreFloatRow(_alpha, y, alpha);
+	}
+}
+
+
+// Running totals for a channel's ProEXRstats.  Each thread keeps its own
+// for the rows it gets and adds them to the shared one at the end.
+class StatsAccumulator
 {
-	float *color = _color_row;
-	float *alpha = _alpha_row;
+  public:
+	StatsAccumulator();
+	~StatsAccumulator() {}
+	
+	void addRow(const ProEXRbuffer &desc, int y, const float *pix); // pix from LoadFloatRow(), before KillNaN
+	void add(const StatsAccumulator &other);
+	
+	ProEXRstats stats() const;
 	
-	for(int x=0; x < _length; x++)
+  private:
+	Int64 _pixels;
+	Int64 _nans;
+	Int64 _infs;
+	Int64 _negatives;
+	double _min, _max, _sum;
+};
+
+StatsAccumulator::StatsAccumulator() :
+	_pixels(0),
+	_nans(0),
+	_infs(0),
+	_negatives(0),
+	_min(std::numeric_limits<double>::infinity()),
+	_max(-std::numeric_limits<double>::infinity()),
+	_sum(0.0)
+{
+
+}
+
+void
+StatsAccumulator::addRow(const ProEXRbuffer &desc, int y, const float *pix)
+{
+	if(desc.type == Imf::UINT)
+	{
+		// IDs and such, no need for a kernel
+		const unsigned int *row = (const unsigned int *)((char *)desc.buf + (desc.rowbytes * y));
+		
+		for(int x=0; x < desc.width; x++)
+		{
+			const double v = row[x];
+			
+			if(v < _min)
+				_min = v;
+			
+			if(v > _max)
+				_max = v;
+			
+			_sum += v;
+		}
+	}
+	else
 	{
-		if(*alpha > 0.f && *alpha < 1.f)
-			*color /= *alpha;
+		PixelRowStats row;
+		
+		PixelStatsRow(pix, desc.width, &row);
+		
+		_nans += row.nans;
+		_infs += row.pos_infs + row.neg_infs;
+		_negatives += row.negatives;
 		
-		color++;
-		alpha++;
+		if(row.min < _min)
+			_min = row.min;
+		
+		if(row.max > _max)
+			_max = row.max;
+		
+		_sum += row.sum;
 	}
+	
+	_pixels += desc.width;
+}
+
+void
+StatsAccumulator::add(const StatsAccumulator &other)
+{
+	_pixels += other._pixels;
+	_nans += other._nans;
+	_infs += other._infs;
+	_negatives += other._negatives;
+	
+	_min = MIN(_min, other._min);
+	_max = MAX(_max, other._max);
+	
+	_sum += other._sum;
+}
+
+ProEXRstats
+StatsAccumulator::stats() const
+{
+	ProEXRstats stats;
+	
+	const Int64 finite = _pixels - _nans - _infs;
+	
+	stats.valid = true;
+	stats.pixels = _pixels;
+	stats.nans = _nans;
+	stats.infs = _infs;
+	stats.negatives = _negatives;
+	stats.min = (finite ? _min : 0.0);
+	stats.max = (finite ? _max : 0.0);
+	stats.mean = (finite ? _sum / (double)finite : 0.0);
+	
+	return stats;
 }
 
 
-class AlphaClipRowTask : public Task
+class KillNaNRows : public ParallelRowKernel
 {
   public:
-	AlphaClipRowTask(TaskGroup *group, float *alpha_row, int length);
-	virtual ~AlphaClipRowTask() {}
+	KillNaNRows(const ProEXRbuffer &pix);
+	virtual ~KillNaNRows() {}
 	
-	virtual void execute();
+	virtual void processRows(int y_start, int y_end);
 
   private:
-	float *_alpha_row;
-	int _length;
+	const ProEXRbuffer _pix;
 };
 
-AlphaClipRowTask::AlphaClipRowTask(TaskGroup *group, float *alpha_row, int length) :
-	Task(group),
-	_alpha_row(alpha_row),
-	_length(length)
+KillNaNRows::KillNaNRows(const ProEXRbuffer &pix) :
+	_pix(pix)
 {
 
 }
 
 void
-AlphaClipRowTask::execute()
+KillNaNRows::processRows(int y_start, int y_end)
 {
-	float *alpha = _alpha_row;
+	Array<float> scratch;
+	
+	SizeScratchRow(scratch, _pix);
 	
-	for(int x=0; x < _length; x++)
+	for(int y = y_start; y < y_end; y++)
 	{
-		if(*alpha < 0.f)
-			*alpha = 0.f;
-		else if(*alpha > 1.f)
-			*alpha = 1.f;
-			
-		alpha++;
+		float *pix = LoadFloatRow(_pix, y, scratch);
+		
+		KillNaNRow(pix, _pix.width);
+		
+		StoreFloatRow(_pix, y, pix);
+	}
+}
+
+
+class ConvertFloatRows : public ParallelRowKernel
+{
+  public:
+	ConvertFloatRows(const char *float_buf, size_t float_rowbytes, char *half_buf, size_t half_rowbytes, int width);
+	virtual ~ConvertFloatRows() {}
+	
+	virtual void processRows(int y_start, int y_end);
+
+  private:
+	const char *_float_buf;
+	size_t _float_rowbytes;
+	char *_half_buf;
+	size_t _half_rowbytes;
+	int _width;
+};
+
+ConvertFloatRows::ConvertFloatRows(const char *float_buf, size_t float_rowbytes, char *half_buf, size_t half_rowbytes, int width) :
+	_float_buf(float_buf),
+	_float_rowbytes(float_rowbytes),
+	_half_buf(half_buf),
+	_half_rowbytes(half_rowbytes),
+	_width(width)
+{
+
+}
+
+void
+ConvertFloatRows::processRows(int y_start, int y_end)
+{
+	for(int y = y_start; y < y_end; y++)
+	{
+		FloatToHalfRow((const float *)(_float_buf + (_float_rowbytes * y)),
+						(half *)(_half_buf + (_half_rowbytes * y)),
+						_width);
 	}
 }
 
 
-class KillNaNRowTask : public Task
+// Everything we do to freshly decoded pixels, done one scanline block at a
+// time right after readPixels() so we're not making extra trips through the
+// whole frame.  Alphas go first so they're clean before anything divides by them.
+// The stats are taken first, so they describe what was in the file.
+typedef struct PostLoadChannel {
+	ProEXRchannel *chan;
+	ProEXRbuffer desc;
+	bool clip;
+	bool unmult;
+	ProEXRbuffer alpha; // only if we're unmultiplying
+	StatsAccumulator stats;
+} PostLoadChannel;
+
+
+class PostLoadRows : public ParallelRowKernel
 {
   public:
-	KillNaNRowTask(TaskGroup *group, float *float_row, int length);
-	virtual ~KillNaNRowTask() {}
+	PostLoadRows(vector<PostLoadChannel> &channels, Mutex &stats_mutex, int first_row, int width);
+	virtual ~PostLoadRows() {}
 	
-	virtual void execute();
+	virtual void processRows(int y_start, int y_end);
 
   private:
-	float *_float_row;
-	int _length;
+	vector<PostLoadChannel> &_channels;
+	Mutex &_stats_mutex;
+	int _first_row;
+	int _width;
 };
 
-KillNaNRowTask::KillNaNRowTask(TaskGroup *group, float *float_row, int length) :
-	Task(group),
-	_float_row(float_row),
-	_length(length)
+PostLoadRows::PostLoadRows(vector<PostLoadChannel> &channels, Mutex &stats_mutex, int first_row, int width) :
+	_channels(channels),
+	_stats_mutex(stats_mutex),
+	_first_row(first_row),
+	_width(width)
 {
 
 }
 
 void
-KillNaNRowTask::execute()
+PostLoadRows::processRows(int y_start, int y_end)
 {
-	float *pix = _float_row;
+	bool half_pix = false, half_alpha = false;
+	
+	for(int c=0; c < _channels.size(); c++)
+	{
+		if(_channels[c].desc.type == Imf::HALF)
+			half_pix = true;
+		
+		if(_channels[c].unmult && _channels[c].alpha.type == Imf::HALF)
+			half_alpha = true;
+	}
+	
+	// LoadFloatRow() only needs scratch for HALF rows
+	Array<float> pix_scratch, alpha_scratch;
 	
-	for(int x=0; x < _length; x++)
+	if(half_pix)
+		pix_scratch.resizeErase(_width);
+	
+	if(half_alpha)
+		alpha_scratch.resizeErase(_width);
+	
+	vector<StatsAccumulator> stats( _channels.size() );
+	
+	for(int y = _first_row + y_start; y < _first_row + y_end; y++)
 	{
-		KillNaN(*pix);
+		for(int c=0; c < _channels.size(); c++)
+		{
+			const PostLoadChannel *i = &_channels[c];
 			
-		pix++;
+			float *pix = LoadFloatRow(i->desc, y, pix_scratch);
+			
+			stats[c].addRow(i->desc, y, pix);
+			
+			KillNaNRow(pix, _width);
+			
+			if(i->clip)
+				AlphaClipRow(pix, _width);
+			
+			if(i->unmult)
+				UnMultiplyRow(pix, LoadFloatRow(i->alpha, y, alpha_scratch), _width);
+			
+			StoreFloatRow(i->desc, y, pix);
+		}
 	}
+	
+	Lock lock(_stats_mutex);
+	
+	for(int c=0; c < _channels.size(); c++)
+		_channels[c].stats.add(stats[c]);
 }
 
 
-class ConvertFloatRowTask : public Task
+class PostLoadPipeline
 {
   public:
-	ConvertFloatRowTask(TaskGroup *group, float *input_row, half *output_row, int length);
-	virtual ~ConvertFloatRowTask() {}
+	PostLoadPipeline(const Box2i &dw) : _dw(dw), _ordered(false) {}
+	~PostLoadPipeline() {}
+	
+	void addChannel(ProEXRchannel *chan, bool clip, ProEXRchannel *unmult_alpha=NULL);
+	
+	void process(int y_start, int y_end); // file scanlines, inclusive
+	void clear(int y_start, int y_end); // for scanlines readPixels() never got to
+	
+	void storeStats(); // give each channel its stats, once all the scanlines are through
+	
+	size_t rowBytes() const; // memory touched per scanline, for sizing blocks
 	
-	virtual void execute();
-
   private:
-	float *_input_row;
-	half *_output_row;
-	int _length;
+	void order();
+	
+	const Box2i _dw;
+	vector<PostLoadChannel> _channels;
+	bool _ordered;
+	Mutex _stats_mutex;
 };
 
-ConvertFloatRowTask::ConvertFloatRowTask(TaskGroup *group, float *input_row, half *output_row, int length) :
-	Task(group),
-	_input_row(input_row),
-	_output_row(output_row),
-	_length(length)
+void
+PostLoadPipeline::addChannel(ProEXRchannel *chan, bool clip, ProEXRchannel *unmult_alpha)
+{
+	PostLoadChannel post;
+	
+	post.chan = chan;
+	post.desc = chan->getBufferDesc(false);
+	post.clip = clip;
+	post.unmult = (unmult_alpha != NULL);
+	
+	if(unmult_alpha)
+	{
+		post.alpha = unmult_alpha->getBufferDesc(false);
+		
+		assert(post.alpha.type != Imf::UINT);
+		assert(post.alpha.height == post.desc.height);
+	}
+	else
+		post.alpha = post.desc;
+	
+	_channels.push_back(post);
+	
+	_ordered = false;
+}
+
+void
+PostLoadPipeline::order()
+{
+	vector<PostLoadChannel> alphas, others;
+	
+	for(vector<PostLoadChannel>::const_iterator i = _channels.begin(); i != _channels.end(); ++i)
+	{
+		bool is_alpha = i->clip;
+		
+		for(vector<PostLoadChannel>::const_iterator j = _channels.begin(); j != _channels.end() && !is_alpha; ++j)
+		{
+			if(j->unmult && j->alpha.buf == i->desc.buf)
+				is_alpha = true;
+		}
+		
+		if(is_alpha)
+			alphas.push_back(*i);
+		else
+			others.push_back(*i);
+	}
+	
+	_channels = alphas;
+	_channels.insert(_channels.end(), others.begin(), others.end());
+	
+	_ordered = true;
+}
+
+void
+PostLoadPipeline::process(int y_start, int y_end)
+{
+	if( _channels.empty() )
+		return;
+	
+	if(!_ordered)
+		order();
+	
+	const int width = (_dw.max.x - _dw.min.x) + 1;
+	
+	const int first_row = MAX(y_start, _dw.min.y) - _dw.min.y;
+	const int last_row = MIN(y_end, _dw.max.y) - _dw.min.y;
+	
+	PostLoadRows rows(_channels, _stats_mutex, first_row, width);
+	
+	ParallelForRows(rows, (last_row - first_row) + 1, rowBytes());
+}
+
+void
+PostLoadPipeline::storeStats()
 {
+	for(vector<PostLoadChannel>::const_iterator i = _channels.begin(); i != _channels.end(); ++i)
+		i->chan->setStats( i->stats.stats() );
+}
 
+size_t
+PostLoadPipeline::rowBytes() const
+{
+	const int width = (_dw.max.x - _dw.min.x) + 1;
+	
+	size_t bytes_per_row = 0;
+	
+	for(vector<PostLoadChannel>::const_iterator i = _channels.begin(); i != _channels.end(); ++i)
+		bytes_per_row += i->desc.colbytes * width;
+	
+	return bytes_per_row;
 }
 
 void
-ConvertFloatRowTask::execute()
+PostLoadPipeline::clear(int y_start, int y_end)
 {
-	float *in = _input_row;
-	half *out = _output_row;
+	// buffers are allocated without zeroing because readPixels() writes
+	// every pixel, except past the point where the file is cut off
+	const int first_row = MAX(y_start, _dw.min.y) - _dw.min.y;
+	const int last_row = MIN(y_end, _dw.max.y) - _dw.min.y;
 	
-	for(int x=0; x < _length; x++)
+	for(vector<PostLoadChannel>::const_iterator i = _channels.begin(); i != _channels.end(); ++i)
 	{
-		*out++ = *in++;
+		for(int y = first_row; y <= last_row; y++)
+			memset((char *)i->desc.buf + (i->desc.rowbytes * y), 0, i->desc.colbytes * i->desc.width);
+	}
+}
+
+// readPixels() threw somewhere in the block starting at y_start, most likely
+// because the file is cut off.  Go back over it a scanline at a time so the
+// ones the file does have are kept, then clear and process the rest.
+static void
+FinishCutOffRead(HybridInputFile &file, PostLoadPipeline &pipeline, int y_start, int y_end)
+{
+	int y = y_start;
+	
+	try{
+		while(y <= y_end)
+		{
+			file.readPixels(y, y);
+			
+			y++;
+		}
 	}
+	catch(Iex::InputExc) {}
+	catch(Iex::IoExc) {}
+	
+	pipeline.clear(y, y_end);
+	pipeline.process(y_start, y_end);
 }
 
+// Scanlines per chunk: readPixels() decodes whole chunks, so a block
+// that ends part way through one makes the next block decode it again.
 static int
-ScanlineBlockSize(const HybridInputFile &in)
+ChunkLines(const Header &head)
 {
-	int block_size = 128;
+	if( head.hasTileDescription() )
+		return head.tileDescription().ySize;
 	
-	if(in.parts() > 1)
+	switch( head.compression() )
 	{
-		// read the whole thing to minimize bouncing around
-		const Box2i &dw = in.dataWindow();
+		case ZIP_COMPRESSION:
+		case PXR24_COMPRESSION:
+			return 16;
 		
-		block_size = dw.max.y - dw.min.y + 1;
+		case PIZ_COMPRESSION:
+		case B44_COMPRESSION:
+		case B44A_COMPRESSION:
+		case DWAA_COMPRESSION:
+			return 32;
+		
+		case DWAB_COMPRESSION:
+			return 256;
+		
+		default:
+			return 1; // none, RLE, ZIPS
 	}
-	else if( isTiled( in.version() ) )
+}
+
+static int
+FloorDiv(int a, int b)
+{
+	return (a >= 0 ? a / b : -((b - 1 - a) / b));
+}
+
+// Decides how many scanlines each readPixels() call in a read loop gets.
+// Blocks end on chunk boundaries of the part with the tallest chunks,
+// have enough chunks (or tiles) in them for every thread to get one,
+// and stay under kBlockMaxBytes unless a single row of chunks won't.
+class ScanlineBlockPlanner
+{
+  public:
+	ScanlineBlockPlanner(const HybridInputFile &in, size_t bytes_per_row);
+	~ScanlineBlockPlanner() {}
+	
+	int blockEnd(int y, int y_max) const; // last scanline of the block starting at y
+	
+  private:
+	int _origin;
+	int _chunk_lines;
+	int _block_lines;
+};
+
+static const size_t kBlockMinBytes = (4 * 1024 * 1024);
+static const size_t kBlockMaxBytes = (64 * 1024 * 1024);
+
+ScanlineBlockPlanner::ScanlineBlockPlanner(const HybridInputFile &in, size_t bytes_per_row) :
+	_origin(0),
+	_chunk_lines(1),
+	_block_lines(1)
+{
+	const Box2i &readW = in.readWindow();
+	const Box2i &proxyW = in.proxyWindow();
+	
+	const int scale = in.proxyScale();
+	
+	const int threads = MAX(globalThreadCount(), 1);
+	
+	int thread_lines = 1;
+	
+	for(int n=0; n < in.parts(); n++)
 	{
-		const TileDescriptionAttribute *tiles = in.header(0).findTypedAttribute<TileDescriptionAttribute>("tiles");
+		const Header &head = in.header(n);
+		const Box2i &dataW = head.dataWindow();
+		
+		// a proxy from a level has the level's tiles, a filtered one
+		// shrinks the file's chunks (these are all in proxy scanlines)
+		const bool filtered = (in.proxyLevel(n) < 0);
+		
+		const int chunk_lines = (filtered ? MAX(ChunkLines(head) / scale, 1) : ChunkLines(head));
+		
+		if(chunk_lines > _chunk_lines)
+		{
+			_chunk_lines = chunk_lines;
+			_origin = in.proxyBox(dataW).min.y;
+		}
 		
-		if(tiles)
+		// scanline parts give each thread a chunk, tiled parts a tile
+		int chunks_across = 1;
+		
+		if( head.hasTileDescription() )
 		{
-			block_size = tiles->value().ySize;
+			const int tile_width = head.tileDescription().xSize;
+			
+			// tiles are counted in file pixels, or level pixels for a level
+			const Box2i partW = (filtered ? dataW : in.proxyBox(dataW));
+			const Box2i &tileW = (filtered ? readW : proxyW);
 			
-			const Box2i &dataW = in.dataWindow();
-			const Box2i &dispW = in.displayWindow();
+			const int x_min = MAX(partW.min.x, tileW.min.x) - partW.min.x;
+			const int x_max = MIN(partW.max.x, tileW.max.x) - partW.min.x;
 			
-			if(dataW != dispW)
-				block_size *= 2; // might not be on tile boundries
+			if(x_max >= x_min)
+				chunks_across = (x_max / tile_width) - (x_min / tile_width) + 1;
 		}
+		
+		const int chunk_rows = (threads + chunks_across - 1) / chunks_across;
+		
+		thread_lines = MAX(thread_lines, chunk_rows * chunk_lines);
+	}
+	
+	int lines = thread_lines;
+	
+	if(bytes_per_row > 0)
+	{
+		// not so small that the calls themselves add up...
+		lines = MAX(lines, (int)(kBlockMinBytes / bytes_per_row));
+		
+		// ...or so big that the post-load pass falls out of cache and aborts lag
+		lines = MIN(lines, (int)(kBlockMaxBytes / bytes_per_row));
+	}
+	
+	_block_lines = MAX(lines / _chunk_lines, 1) * _chunk_lines;
+}
+
+int
+ScanlineBlockPlanner::blockEnd(int y, int y_max) const
+{
+	// back up to the last chunk boundary in a full block...
+	int boundary = _origin + (FloorDiv(y + _block_lines - _origin, _chunk_lines) * _chunk_lines);
+	
+	// ...unless y is in the middle of a chunk and there isn't one
+	if(boundary <= y)
+		boundary = _origin + ((FloorDiv(y - _origin, _chunk_lines) + 1) * _chunk_lines);
+	
+	return MIN(boundary - 1, y_max);
+}
+
+// Scanlines per call when reading or writing a block at a time through
+// something other than HybridInputFile: whole chunks, enough for every
+// thread to get one, and within the same limits as the read loops.
+static int
+ChunkBlockLines(const Header &head, size_t bytes_per_row)
+{
+	const int chunk_lines = ChunkLines(head);
+	const int threads = MAX(globalThreadCount(), 1);
+	
+	int lines = chunk_lines * threads;
+	
+	if(bytes_per_row > 0)
+	{
+		lines = MAX(lines, (int)(kBlockMinBytes / bytes_per_row));
+		lines = MIN(lines, (int)(kBlockMaxBytes / bytes_per_row));
 	}
 	
-	return block_size;
+	return MAX((lines + chunk_lines - 1) / chunk_lines, 1) * chunk_lines;
 }
 
 #pragma mark-
@@ -269,12 +796,14 @@ ProEXRchannel::ProEXRchannel(string name, Imf::PixelType pixelType) :
 	_doc(NULL),
 	_loaded(false),
 	_premultiplied(true),
+	_half_storage(false),
 	_width(0),
 	_height(0),
 	_data(NULL),
 	_half_data(NULL),
 	_rowbytes(0),
-	_half_rowbytes(0)
+	_half_rowbytes(0),
+	_stats()
 {
 
 }
@@ -341,6 +870,9 @@ ProEXRchannel::incrementName()
 	{
 		_name = "layer1." + _name;
 	}
+	
+	if(_doc)
+		_doc->namesChanged();
 }
 
 ChanTag
@@ -397,57 +929,37 @@ ProEXRchannel::assignDoc(ProEXRdoc *doc)
 }
 
 void
-ProEXRchannel::allocateBuffers(bool allocate_half)
+ProEXRchannel::allocateBuffers(bool allocate_half, bool zero_fill)
 {
 	assert(_width && _height);
 	
-	// we always allocate the full-size FLOAT/UINT buffer
+	// we always allocate the full-size FLOAT/UINT buffer (or a HALF one in half storage mode)
 	// only allocate half if we have to (usually for writing half channels only)
 	
-	size_t colbytes, half_colbytes;
-	size_t buf_size, half_buf_size;
-	
-	colbytes = 4;
-	_rowbytes = colbytes * _width;
-	buf_size = _rowbytes * _height;
-	
-	if(allocate_half)
-	{
-		assert(_pixelType == Imf::HALF);
-		
-		half_colbytes = 2;
-		_half_rowbytes = half_colbytes * _width;
-		half_buf_size = _half_rowbytes * _height;
-	}
-	else
-	{
-		half_colbytes = 0;
-		_half_rowbytes = 0;
-		half_buf_size = 0;
-	}
-	
 	queryAbort();
 	
 	if(_data == NULL)
 	{
-		_data = malloc(buf_size);
+		const size_t colbytes = (halfStorage() ? sizeof(half) : 4);
 		
-		if(_data == NULL)
-			throw bad_alloc();
-			
-		memset(_data, 0, buf_size);
+		_rowbytes = colbytes * _width;
+		
+		_data = AllocatePlane(_rowbytes * _height, zero_fill);
+		
+		_stats = ProEXRstats(); // these will be new pixels
 	}
 	
 	queryAbort();
 	
-	if(half_buf_size && _half_data == NULL)
+	if(allocate_half && !halfStorage() && _half_data == NULL)
 	{
-		_half_data = malloc(half_buf_size);
+		assert(_pixelType == Imf::HALF);
 		
-		if(_half_data == NULL)
-			throw bad_alloc();
-			
-		memset(_half_data, 0, half_buf_size);
+		const size_t half_colbytes = 2;
+		
+		_half_rowbytes = half_colbytes * _width;
+		
+		_half_data = AllocatePlane(_half_rowbytes * _height, false); // copyToHalf() fills it
 	}
 	
 	queryAbort();
@@ -458,14 +970,14 @@ ProEXRchannel::freeBuffers()
 {
 	if(_data)
 	{
-		free(_data);
+		FreePlane(_data, _rowbytes * _height);
 		_data = NULL;
 		_rowbytes = 0;
 	}
 	
 	if(_half_data)
 	{
-		free(_half_data);
+		FreePlane(_half_data, _half_rowbytes * _height);
 		_half_data = NULL;
 		_half_rowbytes = 0;
 	}
@@ -474,12 +986,29 @@ ProEXRchannel::freeBuffers()
 }
 
 
+bool
+ProEXRchannel::halfStorage() const
+{
+	return (_pixelType == Imf::HALF && (_half_storage || (_doc && _doc->halfStorage())));
+}
+
 ProEXRbuffer
 ProEXRchannel::getBufferDesc(bool use_half)
 {
 	// allocate half if we're getting a float buffer that will
 	// get converted to half for writing
 	assert(_width && _height);
+	
+	if( halfStorage() )
+	{
+		// _data is already half, so that's what everybody gets
+		if(_data == NULL)
+			allocateBuffers();
+		
+		ProEXRbuffer desc = { Imf::HALF, _data, _width, _height, sizeof(half), _rowbytes };
+		
+		return desc;
+	}
 	 
 	if(_data == NULL || (use_half && _half_data == NULL) )
 		allocateBuffers(use_half && _pixelType == Imf::HALF);
@@ -512,17 +1041,36 @@ ProEXRchannel::fill(float val)
 {
 	if(_data == NULL)
 		allocateBuffers();
-		
-	char *buf_row = (char *)_data;
 	
-	for(int y=0; y < _height; y++)
+	if( halfStorage() )
 	{
-		float *buf_pix = (float *)buf_row;
+		const half half_val(val);
+		
+		char *buf_row = (char *)_data;
 		
-		for(int x=0; x < _width; x++)
-			*buf_pix++ = val;
+		for(int y=0; y < _height; y++)
+		{
+			half *buf_pix = (half *)buf_row;
+			
+			for(int x=0; x < _width; x++)
+				*buf_pix++ = half_val;
+			
+			buf_row += _rowbytes;
+		}
+	}
+	else
+	{
+		char *buf_row = (char *)_data;
 		
-		buf_row += _rowbytes;
+		for(int y=0; y < _height; y++)
+		{
+			float *buf_pix = (float *)buf_row;
+			
+			for(int x=0; x < _width; x++)
+				*buf_pix++ = val;
+			
+			buf_row += _rowbytes;
+		}
 	}
 }
 
@@ -539,20 +1087,12 @@ ProEXRchannel::premultiply(ProEXRchannel *alpha, bool force)
 		{
 			if(!_premultiplied || force)
 			{
-				TaskGroup taskGroup;
+				ProEXRbuffer color_desc = getBufferDesc(false);
+				ProEXRbuffer alpha_desc = alpha->getBufferDesc(false);
 				
-				char *buf_row = (char *)_data;
-				char *alpha_row = (char *)alpha->_data;
+				PremultiplyRows rows(color_desc, alpha_desc);
 				
-				for(int y=0; y < _height; y++)
-				{
-					ThreadPool::addGlobalTask(new PremultiplyRowTask(&taskGroup,
-																		(float *)buf_row,
-																		(float *)alpha_row,
-																		_width) );
-					buf_row += _rowbytes;
-					alpha_row += alpha->_rowbytes;
-				}
+				ParallelForRows(rows, _height, (color_desc.colbytes + alpha_desc.colbytes) * _width);
 				
 				_premultiplied = true;
 			}
@@ -573,20 +1113,12 @@ ProEXRchannel::unMult(ProEXRchannel *alpha)
 		{
 			if(_premultiplied)
 			{
-				TaskGroup taskGroup;
+				ProEXRbuffer color_desc = getBufferDesc(false);
+				ProEXRbuffer alpha_desc = alpha->getBufferDesc(false);
 				
-				char *buf_row = (char *)_data;
-				char *alpha_row = (char *)alpha->_data;
+				UnMultiplyRows rows(color_desc, alpha_desc);
 				
-				for(int y=0; y < _height; y++)
-				{
-					ThreadPool::addGlobalTask(new UnMultiplyRowTask(&taskGroup,
-																		(float *)buf_row,
-																		(float *)alpha_row,
-																		_width) );
-					buf_row += _rowbytes;
-					alpha_row += alpha->_rowbytes;
-				}
+				ParallelForRows(rows, _height, (color_desc.colbytes + alpha_desc.colbytes) * _width);
 				
 				_premultiplied = false;
 			}
@@ -605,17 +1137,11 @@ ProEXRchannel::alphaClip()
 	{
 		if(_pixelType != Imf::UINT)
 		{
-			TaskGroup taskGroup;
+			ProEXRbuffer desc = getBufferDesc(false);
 			
-			char *buf_row = (char *)_data;
+			AlphaClipRows rows(desc);
 			
-			for(int y=0; y < _height; y++)
-			{
-				ThreadPool::addGlobalTask(new AlphaClipRowTask(&taskGroup,
-																(float *)buf_row,
-																_width) );
-				buf_row += _rowbytes;
-			}
+			ParallelForRows(rows, _height, desc.colbytes * _width);
 		}
 		
 		queryAbort();
@@ -627,17 +1153,11 @@ ProEXRchannel::killNaN()
 {
 	if(_loaded && _data)
 	{
-		TaskGroup taskGroup;
+		ProEXRbuffer desc = getBufferDesc(false);
 		
-		char *buf_row = (char *)_data;
+		KillNaNRows rows(desc);
 		
-		for(int y=0; y < _height; y++)
-		{
-			ThreadPool::addGlobalTask(new KillNaNRowTask(&taskGroup,
-															(float *)buf_row,
-															_width) );
-			buf_row += _rowbytes;
-		}
+		ParallelForRows(rows, _height, desc.colbytes * _width);
 		
 		queryAbort();
 	}
@@ -705,20 +1225,9 @@ ProEXRchannel::copyToHalf()
 		if(_width == 0 || _height == 0)
 			throw BaseExc("Image has no size.");
 		
-		TaskGroup taskGroup;
+		ConvertFloatRows rows((char *)_data, _rowbytes, (char *)_half_data, _half_rowbytes, _width);
 		
-		char *float_row = (char *)_data;
-		char *half_row = (char *)_half_data;
-		
-		for(int y=0; y < _height; y++)
-		{
-			ThreadPool::addGlobalTask(new ConvertFloatRowTask(&taskGroup,
-																(float *)float_row,
-																(half *)half_row,
-																_width) );
-			float_row += _rowbytes;
-			half_row += _half_rowbytes;
-		}
+		ParallelForRows(rows, _height, (sizeof(float) + sizeof(half)) * _width);
 	}
 	
 	queryAbort();
@@ -745,68 +1254,64 @@ ProEXRchannel_read::loadFromFile()
 	
 	ProEXRdoc_read &read_doc = dynamic_cast<ProEXRdoc_read &>( *doc() );
 	
+	allocateBuffers(false, !read_doc.file().coversReadWindow()); // no need to clear what readPixels() will write
+	
 	ProEXRbuffer buf = getBufferDesc(false);
 			
 	// EXR calls
-	const Box2i &dw = read_doc.file().dataWindow();
+	const Box2i &dw = read_doc.file().proxyWindow();
 	
 	assert(buf.width == (dw.max.x - dw.min.x) + 1);
 	assert(buf.height == (dw.max.y - dw.min.y) + 1);
 	
 	FrameBuffer frameBuffer;
 	
-	if(buf.type == Imf::UINT)
-	{
-		char *exr_buf_origin = (char *)buf.buf - (sizeof(unsigned int) * dw.min.x) - (buf.rowbytes * dw.min.y);
+	char *exr_buf_origin = (char *)buf.buf - (buf.colbytes * dw.min.x) - (buf.rowbytes * dw.min.y);
 	
-		frameBuffer.insert(name().c_str(), Slice(Imf::UINT, exr_buf_origin, buf.colbytes, buf.rowbytes, 1, 1, 0.0f));
-	}
-	else
-	{
-		float fill_val = (channelTag() == CHAN_A ? 1.0f : 0.0f);
-		
-		char *exr_buf_origin = (char *)buf.buf - (sizeof(float) * dw.min.x) - (buf.rowbytes * dw.min.y);
+	float fill_val = (channelTag() == CHAN_A ? 1.0f : 0.0f);
 	
-		frameBuffer.insert(name().c_str(), Slice(Imf::FLOAT, exr_buf_origin, buf.colbytes, buf.rowbytes, 1, 1, fill_val));
-	}
+	frameBuffer.insert(name().c_str(), Slice(buf.type, exr_buf_origin, buf.colbytes, buf.rowbytes, 1, 1, fill_val));
 
+	PostLoadPipeline pipeline(dw);
+	
+	pipeline.addChannel(this, (channelTag() == CHAN_A && read_doc.getClipAlpha()));
+	
 	// now read the file, pausing to abort if asked
 	HybridInputFile &in_file = read_doc.file();
 	
 	in_file.setFrameBuffer(frameBuffer);
 	
-	try{
-		int block_size = ScanlineBlockSize( read_doc.file() );
+	int y = dw.min.y;
 	
-		int y = dw.min.y;
+	try{
+		const ScanlineBlockPlanner blocks(read_doc.file(), pipeline.rowBytes());
 		
 		while(y <= dw.max.y)
 		{
-			const int high_scanline = MIN(y + block_size - 1, dw.max.y);
+			const int high_scanline = blocks.blockEnd(y, dw.max.y);
 			
 			in_file.readPixels(y, high_scanline);
 			
+			pipeline.process(y, high_scanline);
+			
 			y = high_scanline + 1;
 			
 			queryAbort();
 		}
 	}
-	catch(Iex::InputExc) {}
-	catch(Iex::IoExc) {}
+	catch(Iex::InputExc) { FinishCutOffRead(in_file, pipeline, y, dw.max.y); }
+	catch(Iex::IoExc) { FinishCutOffRead(in_file, pipeline, y, dw.max.y); }
 	
-	setLoaded(true);
-	
-	killNaN();
+	pipeline.storeStats();
 	
-	// clip alpha
-	if(channelTag() == CHAN_A && read_doc.getClipAlpha())
-		alphaClip();
+	setLoaded(true);
 }
 
 ProEXRlayer::ProEXRlayer(string name) :
 	_name(name),
 	_alpha(NULL),
-	_doc(NULL)
+	_doc(NULL),
+	_load_mode(LOAD_RESIDENT)
 {
 
 }
@@ -904,6 +1409,15 @@ ProEXRlayer::ps_name() const
 		return _name;
 }
 
+void
+ProEXRlayer::setName(string name)
+{
+	_name = name;
+	
+	if(_doc)
+		_doc->namesChanged();
+}
+
 void
 ProEXRlayer::incrementChannels()
 {
@@ -934,6 +1448,10 @@ ProEXRlayer::addChannel(ProEXRchannel *channel, bool sort)
 		
 		if(sort)
 			sortChannels();
+		
+		// our name comes from the first channel
+		if(_doc)
+			_doc->namesChanged();
 	}
 }
 
@@ -1080,31 +1598,34 @@ ProEXRlayer::freeBuffers()
 	}
 }
 
+static bool
+ChannelsOutOfOrder(const ProEXRchannel *first, const ProEXRchannel *second)
+{
+	const ChanTag first_tag = first->channelTag();
+	const ChanTag second_tag = second->channelTag();
+	
+	if(first_tag == CHAN_GENERAL || second_tag == CHAN_GENERAL) // untagged case
+		return (first->channelName() > second->channelName());
+	else // tagged case
+		return (first_tag > second_tag);
+}
+
 void
 ProEXRlayer::sortChannels()
 {
 	vector<ProEXRchannel *> &chans = channels();
 
-	for(int i=0; i < chans.size() - 1; i++)
-	{
-		if( (
-			(chans[i]->channelTag() == CHAN_GENERAL || chans[i+1]->channelTag() == CHAN_GENERAL) && // untagged case
-			(chans[i]->channelName() > chans[i+1]->channelName() )
-			)
-			||
-			(
-			(chans[i]->channelTag() != CHAN_GENERAL && chans[i+1]->channelTag() != CHAN_GENERAL) && // tagged case
-			(chans[i]->channelTag() > chans[i+1]->channelTag() )
-			)
-		)
+	// insertion sort, so adding a channel to a sorted layer only walks it back
+	// as far as it has to go instead of starting over for every swap
+	for(int i=1; i < chans.size(); i++)
+	{
+		for(int j=i; j > 0 && ChannelsOutOfOrder(chans[j-1], chans[j]); j--)
 		{
 			// swap
-			ProEXRchannel *temp = chans[i];
+			ProEXRchannel *temp = chans[j-1];
 			
-			chans[i] = chans[i+1];
-			chans[i+1] = temp;
-			
-			i = -1; // start over
+			chans[j-1] = chans[j];
+			chans[j] = temp;
 		}
 	}
 }
@@ -1146,19 +1667,21 @@ ProEXRlayer_read::loadFromFile()
 		HybridInputFile &in_file = read_doc.file();
 		
 		try{
-			vector<ProEXRchannel *> alphas_to_clip;
-		
 			// EXR calls
-			Box2i dw = read_doc.file().dataWindow();
+			Box2i dw = read_doc.file().proxyWindow();
 			
 			FrameBuffer frameBuffer;
 			
+			PostLoadPipeline pipeline(dw);
+			
 			for(vector<ProEXRchannel *>::iterator i = channels().begin(); i != channels().end(); ++i)
 			{
 				ProEXRchannel *chan = *i;
 				
 				if( chan->loaded() == false )
 				{
+					chan->allocateBuffers(false, !in_file.coversReadWindow()); // no need to clear what readPixels() will write
+					
 					ProEXRbuffer desc = chan->getBufferDesc(false);
 						
 					char *exr_buf_origin = (char *)desc.buf - (desc.colbytes * dw.min.x) - (desc.rowbytes * dw.min.y);
@@ -1169,49 +1692,36 @@ ProEXRlayer_read::loadFromFile()
 					
 					chan->setLoaded(true); // yes, I know we haven't actually done it yet
 					
-					if(chan->channelTag() == CHAN_A && read_doc.getClipAlpha())
-						alphas_to_clip.push_back(chan);
+					pipeline.addChannel(chan, (chan->channelTag() == CHAN_A && read_doc.getClipAlpha()));
 				}
 			}
 
 			if(frameBuffer.begin() != frameBuffer.end()) // i.e. not empty
 			{
 				in_file.setFrameBuffer(frameBuffer);
-						
-				try{
-					const int block_size = ScanlineBlockSize( read_doc.file() );
 				
-					int y = dw.min.y;
+				int y = dw.min.y;
+				
+				try{
+					const ScanlineBlockPlanner blocks(read_doc.file(), pipeline.rowBytes());
 					
 					while(y <= dw.max.y)
 					{
-						int high_scanline = MIN(y + block_size - 1, dw.max.y);
+						int high_scanline = blocks.blockEnd(y, dw.max.y);
 						
 						in_file.readPixels(y, high_scanline);
 						
+						pipeline.process(y, high_scanline);
+						
 						y = high_scanline + 1;
 						
 						queryAbort();
 					}
 				}
-				catch(Iex::InputExc) {}
-				catch(Iex::IoExc) {}
-			}
-			
-			// kill NaN
-			for(vector<ProEXRchannel *>::iterator i = channels().begin(); i != channels().end(); ++i)
-			{
-				ProEXRchannel *chan = *i;
-				
-				chan->killNaN();
-			}
-			
-			// clip alpha
-			for(vector<ProEXRchannel *>::iterator i = alphas_to_clip.begin(); i != alphas_to_clip.end(); ++i)
-			{
-				ProEXRchannel *chan = *i;
+				catch(Iex::InputExc) { FinishCutOffRead(in_file, pipeline, y, dw.max.y); }
+				catch(Iex::IoExc) { FinishCutOffRead(in_file, pipeline, y, dw.max.y); }
 				
-				chan->alphaClip();
+				pipeline.storeStats();
 			}
 		}
 		catch(bad_alloc)
@@ -1222,6 +1732,62 @@ ProEXRlayer_read::loadFromFile()
 	}
 }
 
+// averages scale x scale blocks of a file sized Rgba buffer down to one proxy
+// row, starting with row in_y and column in_x, blocks at the edge get cut off
+static void
+BoxFilterRgbaRow(const Array2D<Rgba> &in, int in_y, int in_height, int in_x, int in_width, int scale, Rgba *out, int out_width)
+{
+	const int y_end = MIN(in_y + scale, in_height);
+	
+	for(int x=0; x < out_width; x++)
+	{
+		const int x_start = in_x + (x * scale);
+		const int x_end = MIN(x_start + scale, in_x + in_width);
+		
+		float r = 0.f, g = 0.f, b = 0.f, a = 0.f;
+		
+		for(int y = in_y; y < y_end; y++)
+		{
+			const Rgba *pix = in[y];
+			
+			for(int i = x_start; i < x_end; i++)
+			{
+				r += pix[i].r;
+				g += pix[i].g;
+				b += pix[i].b;
+				a += pix[i].a;
+			}
+		}
+		
+		const float count = (float)((y_end - in_y) * (x_end - x_start));
+		
+		out[x] = Rgba(r / count, g / count, b / count, a / count);
+	}
+}
+
+// one of the four components out of a row of Rgba, either straight
+// from the halfs or from the same row already converted to float
+static void
+StoreRgbaComponent(const ProEXRbuffer &desc, int y, const half *rgba, const float *rgba_float)
+{
+	char *row = (char *)desc.buf + (desc.rowbytes * y);
+	
+	if(desc.type == Imf::HALF)
+	{
+		half *pix = (half *)row;
+		
+		for(int x=0; x < desc.width; x++)
+			pix[x] = rgba[x * 4];
+	}
+	else
+	{
+		float *pix = (float *)row;
+		
+		for(int x=0; x < desc.width; x++)
+			pix[x] = rgba_float[x * 4];
+	}
+}
+
 void
 ProEXRlayer_read::loadFromRGBA()
 {
@@ -1242,6 +1808,10 @@ ProEXRlayer_read::loadFromRGBA()
 		
 		bool have_a = (chans.size() >= 4 && chans[3]->name() == "A");
 		
+		// the copy below writes every pixel
+		for(int c=0; c < (have_a ? 4 : 3); c++)
+			chans[c]->allocateBuffers(false, false);
+		
 		ProEXRbuffer r_desc = chans[0]->getBufferDesc(); // should also allocate float buffer
 		ProEXRbuffer g_desc = chans[1]->getBufferDesc();
 		ProEXRbuffer b_desc = chans[2]->getBufferDesc();
@@ -1265,58 +1835,131 @@ ProEXRlayer_read::loadFromRGBA()
 		
 		Box2i dw = inputFile.dataWindow();
 		int width = (dw.max.x - dw.min.x) + 1;
-		int height = (dw.max.y - dw.min.y) + 1;
 		
-		Array2D<Rgba> half_buffer(height, width);
+		// only the scanlines we were asked for (or the ones behind the proxy
+		// pixels), the columns get cropped below
+		const int scale = read_doc.file().proxyScale();
+		const Box2i &pw = read_doc.file().proxyWindow();
 		
-		inputFile.setFrameBuffer(&half_buffer[-dw.min.y][-dw.min.x], 1, width);
+		Box2i rw;
 		
-		try{
-			int y = dw.min.y;
+		rw.min.x = dw.min.x + ((pw.min.x - dw.min.x) * scale);
+		rw.min.y = dw.min.y + ((pw.min.y - dw.min.y) * scale);
+		rw.max.x = MIN(dw.min.x + ((pw.max.x - dw.min.x + 1) * scale) - 1, dw.max.x);
+		rw.max.y = MIN(dw.min.y + ((pw.max.y - dw.min.y + 1) * scale) - 1, dw.max.y);
+		
+		int height = (rw.max.y - rw.min.y) + 1;
+		
+		assert(buf_width == (pw.max.x - pw.min.x) + 1);
+		assert(buf_height == (pw.max.y - pw.min.y) + 1);
+		
+		// a block of whole proxy rows at a time, decoded into the same staging buffer
+		const int block_rows = MAX(ChunkBlockLines(inputFile.header(), sizeof(Rgba) * width) / scale, 1);
+		
+		Array2D<Rgba> half_buffer(MIN(block_rows * scale, height), width);
+		
+		const bool all_float = (r_desc.type == Imf::FLOAT && g_desc.type == Imf::FLOAT && b_desc.type == Imf::FLOAT &&
+									(!have_a || a_desc.type == Imf::FLOAT));
+		
+		const bool need_float = (r_desc.type != Imf::HALF || g_desc.type != Imf::HALF || b_desc.type != Imf::HALF ||
+									(have_a && a_desc.type != Imf::HALF));
+		
+		Array<float> float_row(need_float && !all_float ? buf_width * 4 : 1);
+		
+		Array<Rgba> proxy_row(scale > 1 ? buf_width : 1);
+		
+		// NaN scrubbing, alpha clip and stats for each block while it's still in cache,
+		// in buffer rows rather than file scanlines
+		PostLoadPipeline pipeline( Box2i(V2i(0, 0), V2i(buf_width - 1, buf_height - 1)) );
+		
+		for(int c=0; c < (have_a ? 4 : 3); c++)
+			pipeline.addChannel(chans[c], (c == 3 && read_doc.getClipAlpha()));
+		
+		bool cut_off = false;
+		
+		for(int block_y = 0; block_y < buf_height; block_y += block_rows)
+		{
+			const int rows = MIN(block_rows, buf_height - block_y);
 			
-			while(y <= dw.max.y)
+			const int y_start = rw.min.y + (block_y * scale);
+			const int y_end = MIN(y_start + (rows * scale) - 1, rw.max.y);
+			
+			const int lines = (y_end - y_start) + 1;
+			
+			inputFile.setFrameBuffer(&half_buffer[-y_start][-dw.min.x], 1, width);
+			
+			if(!cut_off)
 			{
-				int high_scanline = MIN(y + 127, dw.max.y);
-				
-				inputFile.readPixels(y, high_scanline);
-				
-				y = high_scanline + 1;
+				try{
+					inputFile.readPixels(y_start, y_end);
+				}
+				catch(Iex::InputExc) { cut_off = true; }
+				catch(Iex::IoExc) { cut_off = true; }
 				
-				queryAbort();
+				if(cut_off)
+				{
+					// keep whatever scanlines the file still has, the rest are black
+					memset((void *)&half_buffer[0][0], 0, sizeof(Rgba) * width * lines);
+					
+					try{
+						for(int y = y_start; y <= y_end; y++)
+							inputFile.readPixels(y);
+					}
+					catch(Iex::InputExc) {}
+					catch(Iex::IoExc) {}
+				}
 			}
-		}
-		catch(Iex::InputExc) {}
-		catch(Iex::IoExc) {}
-		
-		// copy from big half buffer to our channel buffers
-		char *r_row = (char *)r_desc.buf;
-		char *g_row = (char *)g_desc.buf;
-		char *b_row = (char *)b_desc.buf;
-		char *a_row = (char *)a_desc.buf;
-		
-		for(int y=0; y < buf_height; y++)
-		{
-			float *r_pix = (float *)r_row;
-			float *g_pix = (float *)g_row;
-			float *b_pix = (float *)b_row;
-			float *a_pix = (float *)a_row;
+			else
+				memset((void *)&half_buffer[0][0], 0, sizeof(Rgba) * width * lines);
 			
-			for(int x=0; x < buf_width; x++)
+			// copy from the block to our channel buffers
+			for(int y=0; y < rows; y++)
 			{
-				*r_pix++ = half_buffer[y][x].r;
-				*g_pix++ = half_buffer[y][x].g;
-				*b_pix++ = half_buffer[y][x].b;
+				const int out_y = block_y + y;
+				
+				const half *rgba;
+				
+				if(scale > 1)
+				{
+					BoxFilterRgbaRow(half_buffer, y * scale, lines, rw.min.x - dw.min.x, (rw.max.x - rw.min.x) + 1,
+										scale, proxy_row, buf_width);
+					
+					rgba = &proxy_row[0].r;
+				}
+				else
+					rgba = &half_buffer[y][rw.min.x - dw.min.x].r;
 				
-				if(have_a)
-					*a_pix++ = half_buffer[y][x].a;
+				if(all_float)
+				{
+					// straight from Rgba to planar floats
+					SplitRgbaRow(rgba, (float *)((char *)r_desc.buf + (r_desc.rowbytes * out_y)),
+										(float *)((char *)g_desc.buf + (g_desc.rowbytes * out_y)),
+										(float *)((char *)b_desc.buf + (b_desc.rowbytes * out_y)),
+										(have_a ? (float *)((char *)a_desc.buf + (a_desc.rowbytes * out_y)) : NULL),
+										buf_width);
+				}
+				else
+				{
+					// Rgba is just four halfs, so convert the whole row at once
+					if(need_float)
+						HalfToFloatRow(rgba, &float_row[0], buf_width * 4);
+					
+					StoreRgbaComponent(r_desc, out_y, rgba + 0, &float_row[0] + 0);
+					StoreRgbaComponent(g_desc, out_y, rgba + 1, &float_row[0] + 1);
+					StoreRgbaComponent(b_desc, out_y, rgba + 2, &float_row[0] + 2);
+					
+					if(have_a)
+						StoreRgbaComponent(a_desc, out_y, rgba + 3, &float_row[0] + 3);
+				}
 			}
 			
-			r_row += r_desc.rowbytes;
-			g_row += g_desc.rowbytes;
-			b_row += b_desc.rowbytes;
-			a_row += a_desc.rowbytes;
+			pipeline.process(block_y, block_y + rows - 1);
+			
+			queryAbort();
 		}
 		
+		pipeline.storeStats();
+		
 		// mark as loaded
 		chans[0]->setLoaded(true);
 		chans[1]->setLoaded(true);
@@ -1324,20 +1967,6 @@ ProEXRlayer_read::loadFromRGBA()
 		
 		if(have_a)
 			chans[3]->setLoaded(true);
-		
-		// kill NaN
-		chans[0]->killNaN();
-		chans[1]->killNaN();
-		chans[2]->killNaN();
-		
-		if(have_a)
-			chans[3]->killNaN();
-		
-		// clip alpha
-		if(have_a && read_doc.getClipAlpha())
-			chans[3]->alphaClip();
-		
-		queryAbort();
 	}
 	catch(bad_alloc)
 	{
@@ -1348,7 +1977,10 @@ ProEXRlayer_read::loadFromRGBA()
 
 ProEXRdoc::ProEXRdoc() :
 	_black_channel(NULL),
-	_white_channel(NULL)
+	_white_channel(NULL),
+	_half_storage(false),
+	_memory_budget(0),
+	_names_generation(0)
 {
 
 }
@@ -1386,25 +2018,13 @@ ProEXRdoc::getAlphaChannel() const
 ProEXRchannel *
 ProEXRdoc::findChannel(string channelName) const
 {
-	for(vector<ProEXRchannel *>::const_iterator i = channels().begin(); i != channels().end(); ++i)
-	{
-		if( (*i)->name() == channelName )
-			return *i;
-	}
-	
-	return NULL;
+	return _channel_index.find(channels(), channelName, _names_generation);
 }
 
 ProEXRlayer *
 ProEXRdoc::findLayer(string layerName) const
 {
-	for(vector<ProEXRlayer *>::const_iterator i = layers().begin(); i != layers().end(); ++i)
-	{
-		if( (*i)->name() == layerName )
-			return *i;
-	}
-	
-	return NULL;
+	return _layer_index.find(layers(), layerName, _names_generation);
 }
 
 ProEXRlayer *
@@ -1463,83 +2083,291 @@ ProEXRdoc::loaded() const
 	return loaded;
 }
 
-Int64
-ProEXRdoc::memorySize() const
+ProEXRstats
+ProEXRdoc::stats() const
 {
-	return ( (Int64)sizeof(float) * (Int64)width() * (Int64)height() * (Int64)channels().size() );
+	ProEXRstats stats = ProEXRstats();
+	
+	double sum = 0.0;
+	
+	for(vector<ProEXRchannel *>::const_iterator i = channels().begin(); i != channels().end(); ++i)
+	{
+		const ProEXRstats &chan_stats = (*i)->stats();
+		
+		if(chan_stats.valid)
+		{
+			const Int64 old_finite = stats.pixels - stats.nans - stats.infs;
+			const Int64 chan_finite = chan_stats.pixels - chan_stats.nans - chan_stats.infs;
+			
+			if(chan_finite)
+			{
+				stats.min = (old_finite ? MIN(stats.min, chan_stats.min) : chan_stats.min);
+				stats.max = (old_finite ? MAX(stats.max, chan_stats.max) : chan_stats.max);
+				
+				sum += chan_stats.mean * (double)chan_finite;
+			}
+			
+			stats.valid = true;
+			stats.pixels += chan_stats.pixels;
+			stats.nans += chan_stats.nans;
+			stats.infs += chan_stats.infs;
+			stats.negatives += chan_stats.negatives;
+		}
+	}
+	
+	const Int64 finite = stats.pixels - stats.nans - stats.infs;
+	
+	if(finite)
+		stats.mean = sum / (double)finite;
+	
+	return stats;
 }
 
-void
-ProEXRdoc::freeBuffers() const
+Int64
+ProEXRdoc::memorySize() const
 {
+	Int64 pixel_bytes = 0;
+	
 	for(vector<ProEXRchannel *>::const_iterator j = channels().begin(); j != channels().end(); ++j)
 	{
-		(*j)->freeBuffers();
+		pixel_bytes += ( (*j)->halfStorage() ? sizeof(half) : sizeof(float) );
 	}
+	
+	return ( pixel_bytes * (Int64)width() * (Int64)height() );
 }
 
-void
-ProEXRdoc::premultiply()
-{
-	for(vector<ProEXRlayer *>::iterator i = layers().begin(); i != layers().end(); ++i)
-		(*i)->premultiply( getAlphaChannel() );
-}
-
-void
-ProEXRdoc::unMult()
-{
-	for(vector<ProEXRlayer *>::iterator i = layers().begin(); i != layers().end(); ++i)
-		(*i)->unMult( getAlphaChannel() );
-}
-
-ProEXRdoc_read::ProEXRdoc_read(Imf::IStream &is, bool clip_alpha, bool renameFirstPart, bool set_up) :
-	_in_stream(is),
-	_in_file(is, renameFirstPart),
-	_clipAlpha(clip_alpha)
+// bytes per pixel for a layer, with HALF channels as halfs or as whatever they're set up for
+static Int64
+LayerPixelBytes(const ProEXRlayer &layer, bool as_half)
 {
-	if(set_up)
-		setupDoc();
+	Int64 pixel_bytes = 0;
+	
+	for(vector<ProEXRchannel *>::const_iterator i = layer.channels().begin(); i != layer.channels().end(); ++i)
+	{
+		const bool half_buffer = ((as_half && (*i)->pixelType() == Imf::HALF) || (*i)->halfStorage());
+		
+		pixel_bytes += (half_buffer ? sizeof(half) : sizeof(float));
+	}
+	
+	return pixel_bytes;
 }
 
-ProEXRdoc_read::~ProEXRdoc_read()
+// sorts layer plans biggest first
+class LargerLayerPlan
 {
+  public:
+	LargerLayerPlan(const vector<ProEXRlayerPlan> &plans) : _plans(plans) {}
+	
+	bool operator () (int a, int b) const { return (_plans[a].bytes > _plans[b].bytes); }
+	
+  private:
+	const vector<ProEXRlayerPlan> &_plans;
+};
 
-}
-
-int
-ProEXRdoc_read::width() const
+ProEXRmemoryPlan
+ProEXRdoc::planMemory(bool allow_half) const
 {
-	const Box2i &dw = file().dataWindow();
-			
-	return ((dw.max.x - dw.min.x) + 1);
-}
-
-int
+	const Int64 pixels = (Int64)width() * (Int64)height();
+	
+	ProEXRmemoryPlan plan;
+	
+	plan.budget = memoryBudget();
+	plan.resident = 0;
+	plan.staging = 0;
+	plan.fits = true;
+	
+	// the order layers get given up in: biggest first, but layers holding
+	// an alpha that other layers unmultiply with go last and never get
+	// streamed, because unmultiplying needs the alpha in memory
+	map<const ProEXRchannel *, int> channel_layers;
+	
+	for(int n=0; n < layers().size(); n++)
+	{
+		for(vector<ProEXRchannel *>::const_iterator i = layers()[n]->channels().begin(); i != layers()[n]->channels().end(); ++i)
+			channel_layers[*i] = n;
+	}
+	
+	vector<bool> holds_alpha(layers().size(), false);
+	
+	const ProEXRchannel *shared_alpha = sharedAlpha();
+	
+	if(shared_alpha && channel_layers.find(shared_alpha) != channel_layers.end())
+		holds_alpha[ channel_layers[shared_alpha] ] = true;
+	
+	for(int n=0; n < layers().size(); n++)
+	{
+		const ProEXRchannel *alpha = layers()[n]->alphaChannel();
+		
+		if(alpha && channel_layers.find(alpha) != channel_layers.end() && channel_layers[alpha] != n)
+			holds_alpha[ channel_layers[alpha] ] = true;
+	}
+	
+	vector<int> order;
+	vector<int> alpha_layers;
+	
+	for(int n=0; n < layers().size(); n++)
+	{
+		ProEXRlayer *layer = layers()[n];
+		
+		ProEXRlayerPlan layer_plan;
+		
+		layer_plan.layer = layer;
+		layer_plan.mode = LOAD_RESIDENT;
+		layer_plan.bytes = LayerPixelBytes(*layer, false) * pixels;
+		
+		plan.layers.push_back(layer_plan);
+		
+		plan.resident += layer_plan.bytes;
+		
+		if(holds_alpha[n])
+			alpha_layers.push_back(n);
+		else
+			order.push_back(n);
+	}
+	
+	stable_sort(order.begin(), order.end(), LargerLayerPlan(plan.layers));
+	
+	const int streamable = order.size();
+	
+	order.insert(order.end(), alpha_layers.begin(), alpha_layers.end());
+	
+	if(plan.budget <= 0 || plan.resident <= plan.budget)
+		return plan;
+	
+	// HALF channels were halfs in the file, so keeping them that way costs nothing but conversions
+	if(allow_half)
+	{
+		for(vector<int>::const_iterator i = order.begin(); i != order.end() && plan.resident > plan.budget; ++i)
+		{
+			ProEXRlayerPlan &layer_plan = plan.layers[*i];
+			
+			const Int64 half_bytes = LayerPixelBytes(*layer_plan.layer, true) * pixels;
+			
+			if(half_bytes < layer_plan.bytes)
+			{
+				plan.resident -= (layer_plan.bytes - half_bytes);
+				
+				layer_plan.mode = LOAD_HALF_RESIDENT;
+				layer_plan.bytes = half_bytes;
+			}
+		}
+	}
+	
+	// then stream layers until the rest fit, leaving room to read a block of the biggest one
+	for(vector<int>::const_iterator i = order.begin(); i != order.begin() + streamable && (plan.resident + plan.staging) > plan.budget; ++i)
+	{
+		ProEXRlayerPlan &layer_plan = plan.layers[*i];
+		
+		const Int64 row_bytes = LayerPixelBytes(*layer_plan.layer, false) * (Int64)width();
+		const Int64 block_bytes = MIN(row_bytes * (Int64)height(), MAX(row_bytes, (Int64)kBlockMinBytes));
+		
+		plan.resident -= layer_plan.bytes;
+		plan.staging = MAX(plan.staging, block_bytes);
+		
+		layer_plan.mode = LOAD_STREAMED;
+		layer_plan.bytes = 0;
+	}
+	
+	plan.fits = ((plan.resident + plan.staging) <= plan.budget);
+	
+	return plan;
+}
+
+void
+ProEXRdoc::applyMemoryPlan(const ProEXRmemoryPlan &plan)
+{
+	for(vector<ProEXRlayerPlan>::const_iterator i = plan.layers.begin(); i != plan.layers.end(); ++i)
+	{
+		ProEXRlayer &layer = *i->layer;
+		
+		assert(layer.doc() == this);
+		
+		layer.setLoadMode(i->mode);
+		
+		// channels that already have their buffers stay the way they are
+		for(vector<ProEXRchannel *>::iterator j = layer.channels().begin(); j != layer.channels().end(); ++j)
+		{
+			if( !(*j)->loaded() )
+				(*j)->setHalfStorage(i->mode == LOAD_HALF_RESIDENT);
+		}
+	}
+}
+
+void
+ProEXRdoc::freeBuffers() const
+{
+	for(vector<ProEXRchannel *>::const_iterator j = channels().begin(); j != channels().end(); ++j)
+	{
+		(*j)->freeBuffers();
+	}
+}
+
+void
+ProEXRdoc::premultiply()
+{
+	for(vector<ProEXRlayer *>::iterator i = layers().begin(); i != layers().end(); ++i)
+		(*i)->premultiply( sharedAlpha() );
+}
+
+void
+ProEXRdoc::unMult()
+{
+	for(vector<ProEXRlayer *>::iterator i = layers().begin(); i != layers().end(); ++i)
+		(*i)->unMult( sharedAlpha() );
+}
+
+ProEXRdoc_read::ProEXRdoc_read(Imf::IStream &is, bool clip_alpha, bool renameFirstPart, bool set_up) :
+	_in_stream(is),
+	_in_file(is, renameFirstPart),
+	_clipAlpha(clip_alpha)
+{
+	if(set_up)
+		setupDoc();
+}
+
+ProEXRdoc_read::~ProEXRdoc_read()
+{
+
+}
+
+int
+ProEXRdoc_read::width() const
+{
+	const Box2i &dw = file().proxyWindow();
+			
+	return ((dw.max.x - dw.min.x) + 1);
+}
+
+int
 ProEXRdoc_read::height() const
 {
-	const Box2i &dw = file().dataWindow();
+	const Box2i &dw = file().proxyWindow();
 	
 	return ((dw.max.y - dw.min.y) + 1);
 }
 
 void
-ProEXRdoc_read::loadFromFile()
+ProEXRdoc_read::loadFromFile(bool unmult)
 {
 	try{
-		vector<ProEXRchannel *> alphas_to_clip;
-		
 		// EXR calls
-		const Box2i &dw = file().dataWindow();
+		const Box2i &dw = file().proxyWindow();
 		
 		FrameBuffer frameBuffer;
 
 		vector<ProEXRlayer_read *> layers_to_load;
+		
+		vector< pair<ProEXRchannel *, ProEXRlayer *> > channels_to_load;
 
 		for(vector<ProEXRlayer *>::iterator i = layers().begin(); i != layers().end(); ++i)
 		{
 			ProEXRlayer_read &read_layer = dynamic_cast<ProEXRlayer_read &>( **i );
 			
-			if( read_layer.loadAsLayer() )
+			if(read_layer.loadMode() == LOAD_STREAMED)
+			{
+				continue; // whoever uses it will read it a block at a time
+			}
+			else if( read_layer.loadAsLayer() )
 			{
 				layers_to_load.push_back(&read_layer);
 			}
@@ -1554,6 +2382,8 @@ ProEXRdoc_read::loadFromFile()
 					if( chan->loaded() == false )
 					{
 						const bool this_is_alpha = (chan->channelTag() == CHAN_A);
+						
+						chan->allocateBuffers(false, !file().coversReadWindow()); // no need to clear what readPixels() will write
 					
 						ProEXRbuffer desc = chan->getBufferDesc(false);
 							
@@ -1565,58 +2395,75 @@ ProEXRdoc_read::loadFromFile()
 						
 						chan->setLoaded(true); // yes, I know we haven't actually done it yet
 						
-						if(this_is_alpha && getClipAlpha())
-							alphas_to_clip.push_back(chan);
+						channels_to_load.push_back( pair<ProEXRchannel *, ProEXRlayer *>(chan, &read_layer) );
 					}
 				}
 			}
 		}
+		
+		// set up the post-load work, now that we know which alphas will be there
+		PostLoadPipeline pipeline(dw);
+		
+		for(vector< pair<ProEXRchannel *, ProEXRlayer *> >::iterator i = channels_to_load.begin(); i != channels_to_load.end(); ++i)
+		{
+			ProEXRchannel *chan = i->first;
+			ProEXRlayer *layer = i->second;
+			
+			const bool this_is_alpha = (chan->channelTag() == CHAN_A);
+			
+			ProEXRchannel *unmult_alpha = NULL;
+			
+			if(unmult && chan->pixelType() != Imf::UINT)
+			{
+				// same choices ProEXRlayer::unMult() makes
+				ProEXRchannel *layer_alpha = layer->alphaChannel();
+				
+				ProEXRchannel *first_tagged_alpha = NULL;
+				
+				for(vector<ProEXRchannel *>::const_iterator j = layer->channels().begin(); j != layer->channels().end() && first_tagged_alpha == NULL; ++j)
+				{
+					if((*j)->channelTag() == CHAN_A)
+						first_tagged_alpha = *j;
+				}
+				
+				ProEXRchannel *alpha = (layer_alpha ? layer_alpha : sharedAlpha());
+				
+				if(alpha && alpha != chan && chan != first_tagged_alpha && alpha->loaded() && alpha->pixelType() != Imf::UINT)
+					unmult_alpha = alpha;
+			}
+			
+			pipeline.addChannel(chan, (this_is_alpha && getClipAlpha()), unmult_alpha);
+			
+			if(unmult_alpha)
+				chan->setLoaded(true, false);
+		}
 
 		if(frameBuffer.begin() != frameBuffer.end()) // i.e. not empty
 		{
 			file().setFrameBuffer(frameBuffer);
-					
+			
+			int y = dw.min.y;
+			
 			try{
-				const int block_size = ScanlineBlockSize( file() );
-				
-				int y = dw.min.y;
+				const ScanlineBlockPlanner blocks(file(), pipeline.rowBytes());
 				
 				while(y <= dw.max.y)
 				{
-					int high_scanline = MIN(y + block_size - 1, dw.max.y);
+					int high_scanline = blocks.blockEnd(y, dw.max.y);
 					
 					file().readPixels(y, high_scanline);
 					
+					pipeline.process(y, high_scanline);
+					
 					y = high_scanline + 1;
 					
 					queryAbort();
 				}
 			}
-			catch(Iex::InputExc) {}
-			catch(Iex::IoExc) {}
-		}
-		
-		// kill NaN
-		for(vector<ProEXRlayer *>::iterator i = layers().begin(); i != layers().end(); ++i)
-		{
-			ProEXRlayer_read &read_layer = dynamic_cast<ProEXRlayer_read &>( **i );
-			
-			vector<ProEXRchannel *> &chans = read_layer.channels();
-		
-			for(vector<ProEXRchannel *>::iterator j = chans.begin(); j != chans.end(); ++j)
-			{
-				ProEXRchannel *chan = *j;
-				
-				chan->killNaN();
-			}
-		}
-		
-		// clip alpha
-		for(vector<ProEXRchannel *>::iterator i = alphas_to_clip.begin(); i != alphas_to_clip.end(); ++i)
-		{
-			ProEXRchannel *chan = *i;
+			catch(Iex::InputExc) { FinishCutOffRead(file(), pipeline, y, dw.max.y); }
+			catch(Iex::IoExc) { FinishCutOffRead(file(), pipeline, y, dw.max.y); }
 			
-			chan->alphaClip();
+			pipeline.storeStats();
 		}
 		
 		// any layers to load all together?
@@ -1635,6 +2482,31 @@ ProEXRdoc_read::loadFromFile()
 	}
 }
 
+void
+ProEXRdoc_read::setReadWindow(const Box2i &readWindow)
+{
+	file().setReadWindow(readWindow);
+	
+	// channels were sized for the whole data window
+	for(vector<ProEXRchannel *>::iterator i = channels().begin(); i != channels().end(); ++i)
+	{
+		(*i)->freeBuffers();
+		(*i)->assignDoc(this);
+	}
+}
+
+void
+ProEXRdoc_read::setProxyScale(int scale)
+{
+	file().setProxyScale(scale);
+	
+	for(vector<ProEXRchannel *>::iterator i = channels().begin(); i != channels().end(); ++i)
+	{
+		(*i)->freeBuffers();
+		(*i)->assignDoc(this);
+	}
+}
+
 void
 ProEXRdoc_read::setupDoc()
 {
@@ -1733,6 +2605,137 @@ ProEXRdoc_write::~ProEXRdoc_write()
 	
 }
 
+// A mipmap level for every channel being written, in one plane
+class MipLevel
+{
+  public:
+	MipLevel(const vector<ProEXRbuffer> &level0, int width, int height);
+	~MipLevel() { FreePlane(_plane, _size); }
+	
+	const vector<ProEXRbuffer> & buffers() const { return _buffers; }
+	
+  private:
+	vector<ProEXRbuffer> _buffers;
+	
+	void *_plane;
+	size_t _size;
+};
+
+MipLevel::MipLevel(const vector<ProEXRbuffer> &level0, int width, int height) :
+	_plane(NULL),
+	_size(0)
+{
+	for(vector<ProEXRbuffer>::const_iterator i = level0.begin(); i != level0.end(); ++i)
+	{
+		ProEXRbuffer buf;
+		
+		buf.type = i->type;
+		buf.buf = NULL;
+		buf.width = width;
+		buf.height = height;
+		buf.colbytes = (i->type == Imf::HALF ? sizeof(half) : sizeof(float));
+		buf.rowbytes = buf.colbytes * width;
+		
+		_buffers.push_back(buf);
+		
+		_size += buf.rowbytes * height;
+	}
+	
+	_plane = AllocatePlane(_size, false); // every pixel gets written
+	
+	char *buf = (char *)_plane;
+	
+	for(vector<ProEXRbuffer>::iterator i = _buffers.begin(); i != _buffers.end(); ++i)
+	{
+		i->buf = buf;
+		
+		buf += i->rowbytes * i->height;
+	}
+}
+
+static inline float
+MipSample(const ProEXRbuffer &buf, const char *row, int x)
+{
+	const char *pix = row + (buf.colbytes * x);
+	
+	return (buf.type == Imf::HALF ? (float)*(const half *)pix : *(const float *)pix);
+}
+
+// Each level is the one before it with 2x2 blocks averaged, or 2x1, 1x2 and
+// 1x1 blocks along the edges when the sizes round up.  UINT channels just
+// take the top left pixel.
+class MipReduceRows : public ParallelRowKernel
+{
+  public:
+	MipReduceRows(const vector<ProEXRbuffer> &from, const vector<ProEXRbuffer> &to) : _from(from), _to(to) {}
+	virtual ~MipReduceRows() {}
+	
+	virtual void processRows(int y_start, int y_end);
+	
+  private:
+	const vector<ProEXRbuffer> &_from;
+	const vector<ProEXRbuffer> &_to;
+};
+
+void
+MipReduceRows::processRows(int y_start, int y_end)
+{
+	for(int c=0; c < _to.size(); c++)
+	{
+		const ProEXRbuffer &from = _from[c];
+		const ProEXRbuffer &to = _to[c];
+		
+		for(int y = y_start; y < y_end; y++)
+		{
+			const int y1 = (2 * y);
+			const int y2 = MIN(y1 + 1, from.height - 1);
+			
+			const char *row1 = (const char *)from.buf + (from.rowbytes * y1);
+			const char *row2 = (const char *)from.buf + (from.rowbytes * y2);
+			
+			char *out = (char *)to.buf + (to.rowbytes * y);
+			
+			for(int x=0; x < to.width; x++)
+			{
+				const int x1 = (2 * x);
+				const int x2 = MIN(x1 + 1, from.width - 1);
+				
+				if(to.type == Imf::UINT)
+				{
+					((unsigned int *)out)[x] = *(const unsigned int *)(row1 + (from.colbytes * x1));
+				}
+				else
+				{
+					const float average = 0.25f * (MipSample(from, row1, x1) + MipSample(from, row1, x2) +
+													MipSample(from, row2, x1) + MipSample(from, row2, x2));
+					
+					if(to.type == Imf::HALF)
+						((half *)out)[x] = average;
+					else
+						((float *)out)[x] = average;
+				}
+			}
+		}
+	}
+}
+
+static FrameBuffer
+LevelFrameBuffer(const vector<string> &names, const vector<ProEXRbuffer> &buffers, const V2i &origin)
+{
+	FrameBuffer frameBuffer;
+	
+	for(int i=0; i < names.size(); i++)
+	{
+		const ProEXRbuffer &buffer = buffers[i];
+		
+		char *exr_origin = (char *)buffer.buf - (origin.y * buffer.rowbytes) - (origin.x * buffer.colbytes);
+		
+		frameBuffer.insert(names[i].c_str(), Slice(buffer.type, exr_origin, buffer.colbytes, buffer.rowbytes) );
+	}
+	
+	return frameBuffer;
+}
+
 void
 ProEXRdoc_write::writeFile()
 {
@@ -1744,7 +2747,8 @@ ProEXRdoc_write::writeFile()
 	Box2i dw = head.dataWindow();
 	int dw_height = (dw.max.y - dw.min.y) + 1;
 	
-	FrameBuffer frameBuffer;
+	vector<string> names;
+	vector<ProEXRbuffer> buffers;
 	
 	for(int i=0; i < chans.size(); i++)
 	{
@@ -1759,18 +2763,78 @@ ProEXRdoc_write::writeFile()
 			if(buffer.buf == NULL)
 				throw BaseExc("buffer.buf is NULL.");
 			
-			char *exr_origin = (char *)buffer.buf - (dw.min.y * buffer.rowbytes) - (dw.min.x * buffer.colbytes);
-			
-			frameBuffer.insert(chan->name().c_str(),
-						Slice(chan->pixelType(), exr_origin, buffer.colbytes, buffer.rowbytes) );
+			names.push_back( chan->name() );
+			buffers.push_back(buffer);
 		}
 	}
 	
-	OutputFile file(stream(), head);
-	
-	file.setFrameBuffer(frameBuffer);
-	
-	file.writePixels(dw_height);
+	if( head.hasTileDescription() )
+	{
+		// tiles, and maybe mipmaps made from our channels as we go
+		const LevelMode mode = head.tileDescription().mode;
+		
+		if(mode == RIPMAP_LEVELS)
+			throw ArgExc("Ripmap output is not supported.");
+		
+		TiledOutputFile file(stream(), head);
+		
+		file.setFrameBuffer( LevelFrameBuffer(names, buffers, dw.min) );
+		
+		file.writeTiles(0, file.numXTiles(0) - 1, 0, file.numYTiles(0) - 1, 0);
+		
+		MipLevel *previous = NULL; // each level is made from the one before
+		MipLevel *level = NULL;
+		
+		try
+		{
+			for(int l=1; l < file.numLevels(); l++)
+			{
+				queryAbort();
+				
+				const Box2i levelW = file.dataWindowForLevel(l);
+				
+				const int width = (levelW.max.x - levelW.min.x) + 1;
+				const int height = (levelW.max.y - levelW.min.y) + 1;
+				
+				level = new MipLevel(buffers, width, height);
+				
+				size_t bytes_per_row = 0;
+				
+				for(vector<ProEXRbuffer>::const_iterator i = level->buffers().begin(); i != level->buffers().end(); ++i)
+					bytes_per_row += i->rowbytes * 5; // two rows in for every row out, each twice as wide
+				
+				MipReduceRows reduce((previous ? previous->buffers() : buffers), level->buffers());
+				
+				ParallelForRows(reduce, height, bytes_per_row);
+				
+				delete previous;
+				
+				previous = level;
+				level = NULL;
+				
+				file.setFrameBuffer( LevelFrameBuffer(names, previous->buffers(), levelW.min) );
+				
+				file.writeTiles(0, file.numXTiles(l) - 1, 0, file.numYTiles(l) - 1, l);
+			}
+		}
+		catch(...)
+		{
+			delete level;
+			delete previous;
+			
+			throw;
+		}
+		
+		delete previous;
+	}
+	else
+	{
+		OutputFile file(stream(), head);
+		
+		file.setFrameBuffer( LevelFrameBuffer(names, buffers, dw.min) );
+		
+		file.writePixels(dw_height);
+	}
 }
 
 
@@ -1797,6 +2861,72 @@ ProEXRdoc_writeRGBA::writeFile()
 	writeRGBAfile(stream(), header(), _mode, r_chan, g_chan, b_chan, a_chan);
 }
 
+// a row of halfs, converting floats into the scratch row if necessary
+static inline const half *
+HalfRow(Imf::PixelType type, const char *row, half *scratch, int width)
+{
+	if(type == Imf::HALF)
+		return (const half *)row;
+	
+	FloatToHalfRow((const float *)row, scratch, width);
+	
+	return scratch;
+}
+
+// Interleaves rows of r, g, b (and a, if it's there) into a block of Rgba,
+// repeating the last row and column of the channels for the padding YCC needs
+class RgbaBlockRows : public ParallelRowKernel
+{
+  public:
+	RgbaBlockRows(const vector<ProEXRbuffer> &descs, Rgba *block, int first_row, int width) :
+		_descs(descs), _block(block), _first_row(first_row), _width(width) {}
+	virtual ~RgbaBlockRows() {}
+	
+	virtual void processRows(int y_start, int y_end); // rows of the block
+	
+  private:
+	const vector<ProEXRbuffer> &_descs;
+	Rgba *_block;
+	int _first_row;
+	int _width;
+};
+
+void
+RgbaBlockRows::processRows(int y_start, int y_end)
+{
+	const int buf_width = _descs[0].width;
+	const int buf_height = _descs[0].height;
+	
+	Array2D<half> half_rows(4, buf_width);
+	
+	for(int y = y_start; y < y_end; y++)
+	{
+		const int row = MIN(_first_row + y, buf_height - 1);
+		
+		const half *chans[4] = { NULL, NULL, NULL, NULL };
+		
+		for(int c=0; c < _descs.size(); c++)
+		{
+			const ProEXRbuffer &desc = _descs[c];
+			
+			chans[c] = HalfRow(desc.type, (const char *)desc.buf + (desc.rowbytes * row), half_rows[c], buf_width);
+		}
+		
+		Rgba *out = _block + ((size_t)_width * y);
+		
+		for(int x=0; x < buf_width; x++)
+		{
+			out[x].r = chans[0][x];
+			out[x].g = chans[1][x];
+			out[x].b = chans[2][x];
+			out[x].a = (chans[3] ? chans[3][x] : half(1.0f));
+		}
+		
+		for(int x = buf_width; x < _width; x++)
+			out[x] = out[buf_width - 1];
+	}
+}
+
 void writeRGBAfile(Imf::OStream &os, Imf::Header &header, Imf::RgbaChannels mode,
 					ProEXRchannel *r_chan, ProEXRchannel *g_chan, ProEXRchannel *b_chan, ProEXRchannel *a_chan)
 {
@@ -1839,89 +2969,468 @@ void writeRGBAfile(Imf::OStream &os, Imf::Header &header, Imf::RgbaChannels mode
 		}
 	}
 	
-	ProEXRbuffer r_desc = r_chan->getBufferDesc(true); // may as well get half
-	ProEXRbuffer g_desc = g_chan->getBufferDesc(true);
-	ProEXRbuffer b_desc = b_chan->getBufferDesc(true);
+	// we convert to half row by row below (if they aren't half already), no need for the channels to make whole half copies
+	vector<ProEXRbuffer> descs;
 	
-	if(r_desc.buf == NULL || g_desc.buf == NULL || b_desc.buf == NULL)
-		throw BaseExc("missing buffers.");
+	descs.push_back( r_chan->getBufferDesc(false) );
+	descs.push_back( g_chan->getBufferDesc(false) );
+	descs.push_back( b_chan->getBufferDesc(false) );
 	
-	assert(r_desc.type == Imf::HALF && g_desc.type == Imf::HALF && b_desc.type == Imf::HALF);
-	assert(r_desc.width == g_desc.width && g_desc.width == b_desc.width);
-	assert(r_desc.height == g_desc.height && g_desc.height == b_desc.height);
+	if(a_chan)
+		descs.push_back( a_chan->getBufferDesc(false) );
 	
-	int buf_width = r_desc.width;
-	int buf_height = r_desc.height;
+	size_t bytes_per_row = sizeof(Rgba) * width;
 	
-	int fill_cols = width - buf_width;
-	int fill_rows = height - buf_height;
+	for(vector<ProEXRbuffer>::const_iterator i = descs.begin(); i != descs.end(); ++i)
+	{
+		if(i->buf == NULL)
+			throw BaseExc("missing buffers.");
+		
+		assert(i->type != Imf::UINT);
+		assert(i->width == descs[0].width && i->height == descs[0].height);
+		
+		bytes_per_row += i->rowbytes;
+	}
 	
-	// must fill this Rgba buffer
-	Array2D<Rgba> half_buffer(height, width);
 	
-	char *r_row = (char *)r_desc.buf;
-	char *g_row = (char *)g_desc.buf;
-	char *b_row = (char *)b_desc.buf;
+	// now write our file, a block of interleaved rows at a time
+	RgbaOutputFile file(os, header, mode);
 	
-	char *a_row = NULL;
-	size_t a_rowbytes = 0;
+	assert(dw.min.x == 0 && dw.min.y == 0);
 	
-	if(a_chan)
+	const int block_lines = MIN(ChunkBlockLines(header, bytes_per_row), height);
+	
+	Array2D<Rgba> block_buffer(block_lines, width);
+	
+	const bool decreasing = (header.lineOrder() == DECREASING_Y);
+	
+	for(int done = 0; done < height; )
 	{
-		ProEXRbuffer a_desc = a_chan->getBufferDesc(true);
+		const int lines = MIN(block_lines, height - done);
+		const int first_row = (decreasing ? (height - done - lines) : done);
+		
+		RgbaBlockRows interleave(descs, &block_buffer[0][0], first_row, width);
 		
-		if(a_desc.buf == NULL)
-			throw BaseExc("missing buffer.");
+		ParallelForRows(interleave, lines, bytes_per_row);
 		
-		assert(a_desc.type == Imf::HALF);
-		assert(a_desc.width == buf_width);
-		assert(a_desc.height == buf_height);
+		file.setFrameBuffer(&block_buffer[0][0] - ((size_t)first_row * width), 1, width);
 		
-		a_row = (char *)a_desc.buf;
-		a_rowbytes = a_desc.rowbytes;
+		file.writePixels(lines);
+		
+		done += lines;
 	}
+}
+
+#pragma mark-
+
+// one block being written while a couple more get filled
+static const int kStreamBlocks = 3;
+
+class ProEXRstreamWriter::StreamBlock
+{
+  public:
+	StreamBlock(int channels) : planes(channels, (void *)NULL), sizes(channels, 0), ready(channels, false), num_ready(0) {}
+	~StreamBlock();
 	
-	for(int y=0; y < buf_height; y++)
+	bool complete() const { return (num_ready == ready.size()); }
+	
+	vector<void *> planes;
+	vector<size_t> sizes;
+	vector<bool> ready;
+	int num_ready;
+};
+
+ProEXRstreamWriter::StreamBlock::~StreamBlock()
+{
+	for(int c=0; c < planes.size(); c++)
 	{
-		half *r = (half *)r_row;
-		half *g = (half *)g_row;
-		half *b = (half *)b_row;
-		half *a = (half *)a_row;
+		if(planes[c] != NULL)
+			FreePlane(planes[c], sizes[c]);
+	}
+}
+
+class ProEXRstreamWriter::WriterThread : public Thread
+{
+  public:
+	WriterThread(ProEXRstreamWriter &writer) : _writer(writer) { start(); }
+	virtual ~WriterThread() {} // Thread's destructor waits for run() to return
 	
-		for(int x=0; x < buf_width; x++)
+	virtual void run() { _writer.writerLoop(); }
+	
+  private:
+	ProEXRstreamWriter &_writer;
+};
+
+// a block's rows of one channel, minus the memory
+static ProEXRbuffer
+StreamBuffer(Imf::PixelType type, const Box2i &blockW)
+{
+	ProEXRbuffer desc;
+	
+	desc.type = type;
+	desc.buf = NULL;
+	desc.width = (blockW.max.x - blockW.min.x) + 1;
+	desc.height = (blockW.max.y - blockW.min.y) + 1;
+	desc.colbytes = (type == Imf::HALF ? sizeof(half) : sizeof(float));
+	desc.rowbytes = desc.colbytes * desc.width;
+	
+	return desc;
+}
+
+ProEXRstreamWriter::ProEXRstreamWriter(OStream &os, const Header &header,
+										int block_lines, int max_blocks, bool float_buffers) :
+	_file(NULL),
+	_dw(header.dataWindow()),
+	_decreasing(header.lineOrder() == DECREASING_Y),
+	_block_lines(1),
+	_blocks(0),
+	_max_blocks(max_blocks > 0 ? max_blocks : kStreamBlocks),
+	_written(0),
+	_finishing(false),
+	_failed(false),
+	_room_waiters(0),
+	_thread(NULL)
+{
+	if( header.hasTileDescription() )
+		throw ArgExc("Only scanline files can be streamed.");
+	
+	const int width = (_dw.max.x - _dw.min.x) + 1;
+	const int height = (_dw.max.y - _dw.min.y) + 1;
+	
+	size_t bytes_per_row = 0;
+	
+	for(ChannelList::ConstIterator i = header.channels().begin(); i != header.channels().end(); ++i)
+	{
+		const Imf::PixelType type = ((float_buffers && i.channel().type == Imf::HALF) ? Imf::FLOAT : i.channel().type);
+		
+		_channel_index[i.name()] = _names.size();
+		
+		_names.push_back( i.name() );
+		_types.push_back(type);
+		
+		bytes_per_row += (type == Imf::HALF ? sizeof(half) : sizeof(float)) * width;
+	}
+	
+	if( _names.empty() )
+		throw ArgExc("No channels to write.");
+	
+	_block_lines = MIN((block_lines > 0 ? block_lines : ChunkBlockLines(header, bytes_per_row)), height);
+	
+	_blocks = (height + _block_lines - 1) / _block_lines;
+	
+	_file = new OutputFile(os, header);
+	
+	if(supportsThreads() && globalThreadCount() > 0)
+	{
+		try
 		{
-			half_buffer[y][x].r = *r++;
-			half_buffer[y][x].g = *g++;
-			half_buffer[y][x].b = *b++;
+			_thread = new WriterThread(*this);
+		}
+		catch(...)
+		{
+			delete _file;
 			
-			if(a)
-				half_buffer[y][x].a = *a++;
-			else
-				half_buffer[y][x].a = half(1.0f);
+			throw;
 		}
+	}
+}
+
+ProEXRstreamWriter::~ProEXRstreamWriter()
+{
+	if(_thread)
+	{
+		// stop the writer after the block it's on
+		fail("Stream abandoned.");
 		
-		for(int c=1; c <= fill_cols; c++)
-			half_buffer[y][(buf_width-1)+c] = half_buffer[y][buf_width-1];
+		_work.post();
 		
-		r_row += r_desc.rowbytes;
-		g_row += g_desc.rowbytes;
-		b_row += b_desc.rowbytes;
-		a_row += a_rowbytes;
+		delete _thread;
 	}
 	
-	for(int r=1; r <= fill_rows; r++)
-		for(int x=0; x < width; x++)
-			half_buffer[(buf_height-1)+r][x] = half_buffer[buf_height-1][x];
+	delete _file; // nobody's writing to it now
 	
+	for(map<int, StreamBlock *>::iterator i = _live.begin(); i != _live.end(); ++i)
+		delete i->second;
+}
+
+const Header &
+ProEXRstreamWriter::header() const
+{
+	return _file->header();
+}
+
+Box2i
+ProEXRstreamWriter::blockWindow(int block) const
+{
+	assert(block >= 0 && block < _blocks);
 	
-	// now write our file
-	RgbaOutputFile file(os, header, mode);
+	const int y_start = _dw.min.y + (block * _block_lines);
+	const int y_end = MIN(y_start + _block_lines - 1, _dw.max.y);
 	
-	assert(dw.min.x == 0 && dw.min.y == 0);
+	return Box2i(V2i(_dw.min.x, y_start), V2i(_dw.max.x, y_end));
+}
+
+int
+ProEXRstreamWriter::orderedBlock(int n) const
+{
+	// works both ways: a block's place in line is orderedBlock(block)
+	return (_decreasing ? (_blocks - 1 - n) : n);
+}
+
+ProEXRbuffer
+ProEXRstreamWriter::channelBuffer(int block, const string &name)
+{
+	if(block < 0 || block >= _blocks)
+		throw ArgExc("Block is out of range.");
+	
+	map<string, int>::const_iterator chan = _channel_index.find(name);
+	
+	if(chan == _channel_index.end())
+		throw ArgExc("Channel is not in the header.");
+	
+	const int c = chan->second;
+	const int place = orderedBlock(block);
+	
+	Lock lock(_mutex);
+	
+	StreamBlock *blk = NULL;
+	
+	while(blk == NULL)
+	{
+		if(_failed)
+			throw BaseExc(_error);
+		
+		if(place < _written)
+			throw LogicExc("Block has already been written.");
+		
+		map<int, StreamBlock *>::iterator i = _live.find(block);
+		
+		if(i != _live.end())
+		{
+			blk = i->second;
+		}
+		else if(place < _written + _max_blocks)
+		{
+			blk = _live[block] = new StreamBlock( _names.size() );
+		}
+		else if(_thread == NULL)
+		{
+			// the blocks in front of this one are never going to get written
+			throw LogicExc("Blocks have to be filled in line order.");
+		}
+		else
+		{
+			_room_waiters++;
+			
+			lock.release();
+			
+			_room.wait();
+			
+			lock.acquire();
+		}
+	}
+	
+	ProEXRbuffer desc = StreamBuffer(_types[c], blockWindow(block));
+	
+	if(blk->planes[c] == NULL)
+	{
+		const size_t size = desc.rowbytes * desc.height;
+		
+		blk->planes[c] = AllocatePlane(size, false); // the producer fills every pixel
+		blk->sizes[c] = size;
+	}
+	
+	desc.buf = blk->planes[c];
+	
+	return desc;
+}
+
+void
+ProEXRstreamWriter::channelReady(int block, const string &name)
+{
+	map<string, int>::const_iterator chan = _channel_index.find(name);
+	
+	if(chan == _channel_index.end())
+		throw ArgExc("Channel is not in the header.");
+	
+	const int c = chan->second;
+	
+	bool complete = false;
+	
+	{
+		Lock lock(_mutex);
+		
+		if(_failed)
+			throw BaseExc(_error);
+		
+		map<int, StreamBlock *>::iterator i = _live.find(block);
+		
+		if(i == _live.end() || i->second->planes[c] == NULL)
+			throw LogicExc("Channel buffer was never requested.");
+		
+		StreamBlock &blk = *i->second;
+		
+		if( !blk.ready[c] )
+		{
+			blk.ready[c] = true;
+			blk.num_ready++;
+		}
+		
+		complete = blk.complete();
+	}
+	
+	if(complete)
+	{
+		if(_thread)
+		{
+			_work.post();
+		}
+		else
+		{
+			writeReadyBlocks();
+			
+			Lock lock(_mutex);
+			
+			if(_failed)
+				throw BaseExc(_error);
+		}
+	}
+}
+
+void
+ProEXRstreamWriter::finish()
+{
+	if(_thread)
+	{
+		{
+			Lock lock(_mutex);
+			
+			_finishing = true;
+		}
+		
+		_work.post();
+		
+		delete _thread;
+		
+		_thread = NULL;
+	}
 	
-	file.setFrameBuffer(&half_buffer[0][0], 1, width);
+	Lock lock(_mutex);
 	
-	file.writePixels(height);
+	if(_failed)
+		throw BaseExc(_error);
+	
+	if(_written < _blocks)
+		throw LogicExc("Not every block was filled in.");
+}
+
+void
+ProEXRstreamWriter::writerLoop()
+{
+	while(true)
+	{
+		_work.wait();
+		
+		writeReadyBlocks();
+		
+		Lock lock(_mutex);
+		
+		if(_finishing || _failed || _written == _blocks)
+			return;
+	}
+}
+
+void
+ProEXRstreamWriter::writeReadyBlocks()
+{
+	try
+	{
+		while(true)
+		{
+			int block = 0;
+			StreamBlock *blk = NULL;
+			
+			{
+				Lock lock(_mutex);
+				
+				if(_failed || _written == _blocks)
+					return;
+				
+				block = orderedBlock(_written);
+				
+				map<int, StreamBlock *>::iterator i = _live.find(block);
+				
+				if(i == _live.end() || !i->second->complete())
+					return;
+				
+				blk = i->second;
+			}
+			
+			// the producers only touch other blocks now, so no lock while compressing
+			const Box2i blockW = blockWindow(block);
+			
+			FrameBuffer frameBuffer;
+			
+			for(int c=0; c < _names.size(); c++)
+			{
+				const ProEXRbuffer desc = StreamBuffer(_types[c], blockW);
+				
+				char *exr_origin = (char *)blk->planes[c] - (blockW.min.y * desc.rowbytes) - (blockW.min.x * desc.colbytes);
+				
+				frameBuffer.insert(_names[c].c_str(), Slice(desc.type, exr_origin, desc.colbytes, desc.rowbytes) );
+			}
+			
+			_file->setFrameBuffer(frameBuffer);
+			
+			_file->writePixels( (blockW.max.y - blockW.min.y) + 1 );
+			
+			{
+				Lock lock(_mutex);
+				
+				_live.erase(block);
+				
+				_written++;
+				
+				wakeWaiters();
+			}
+			
+			delete blk;
+		}
+	}
+	catch(const std::exception &e)
+	{
+		fail( e.what() );
+	}
+	catch(...)
+	{
+		fail("Error writing scanlines.");
+	}
+}
+
+void
+ProEXRstreamWriter::fail(const string &error)
+{
+	Lock lock(_mutex);
+	
+	if(!_failed)
+	{
+		_failed = true;
+		_error = error;
+	}
+	
+	wakeWaiters();
+}
+
+void
+ProEXRstreamWriter::wakeWaiters()
+{
+	// call with _mutex locked
+	while(_room_waiters > 0)
+	{
+		_room_waiters--;
+		
+		_room.post();
+	}
 }
 
 
@@ -25,6 +25,7 @@
 #define __ProEXRdoc_H__
 
 #include <vector>
+#include <map>
 
 #include <ImfRgbaFile.h>
 #include "ImfHybridInputFile.h"
@@ -33,6 +34,9 @@
 
 #include <IexBaseExc.h>
 
+#include <IlmThreadMutex.h>
+#include <IlmThreadSemaphore.h>
+
 #include <assert.h>
 
 // exception to throw when queryAbort() returns yes
@@ -62,6 +66,15 @@ enum ChanTag
 };
 
 
+// how a layer holds its pixels, see ProEXRdoc::planMemory()
+enum LoadMode
+{
+	LOAD_RESIDENT = 0,	// all of it, in floats (or halfs with halfStorage())
+	LOAD_HALF_RESIDENT,	// all of it, with HALF channels in 2-byte buffers
+	LOAD_STREAMED		// nothing kept, read a block at a time when it's needed
+};
+
+
 struct ProEXRbuffer {
 	Imf::PixelType type;
 	void *buf;
@@ -72,6 +85,19 @@ struct ProEXRbuffer {
 };
 
 
+// What a channel's pixels looked like coming out of the file, before KillNaN
+// and the rest of the post-load work got to them.  It's gathered in that same
+// pass, so channels that never went through one (streamed ones) aren't valid.
+struct ProEXRstats {
+	bool valid;
+	Imath::Int64 pixels;
+	Imath::Int64 nans;
+	Imath::Int64 infs;		// + or -
+	Imath::Int64 negatives;	// finite pixels below 0
+	double min, max, mean;	// of the finite pixels, all 0 if there weren't any
+};
+
+
 class ProEXRdoc; // forward declaration
 
 class ProEXRchannel
@@ -92,13 +118,15 @@ class ProEXRchannel
 	void assignDoc(ProEXRdoc *doc);
 	ProEXRdoc *doc() const { return _doc; }
 	
-	void allocateBuffers(bool allocate_half=false);
+	void allocateBuffers(bool allocate_half=false, bool zero_fill=true); // skip zero_fill if every pixel is about to be written
 	void freeBuffers();
 	
 	template <class ChannelType>
 	std::vector<ChannelType *> getUintRGBchannels(); // the recipient is responsible for deleting these channels
 	
-	ProEXRbuffer getBufferDesc(bool use_half=false);
+	ProEXRbuffer getBufferDesc(bool use_half=false); // HALF whenever halfStorage(), whatever you ask for
+	bool halfStorage() const;
+	void setHalfStorage(bool half_storage) { _half_storage = half_storage; } // just this channel, before allocating
 	
 	bool loaded() const { return _loaded; }
 	void setLoaded(bool loaded, bool premultiplied=true) { _loaded = loaded; _premultiplied = premultiplied; }
@@ -108,6 +136,9 @@ class ProEXRchannel
 	void unMult(ProEXRchannel *alpha);
 	void alphaClip();
 	void killNaN();
+	
+	const ProEXRstats &stats() const { return _stats; }
+	void setStats(const ProEXRstats &stats) { _stats = stats; }
 
   protected:
 	void queryAbort();
@@ -125,6 +156,7 @@ class ProEXRchannel
 
 	bool _loaded;
 	bool _premultiplied;
+	bool _half_storage;
 	
 	int _width, _height;
 	
@@ -132,6 +164,8 @@ class ProEXRchannel
 	void *_half_data;
 	
 	size_t _rowbytes, _half_rowbytes;
+	
+	ProEXRstats _stats;
 };
 
 class ProEXRchannel_read : public ProEXRchannel
@@ -169,6 +203,9 @@ class ProEXRlayer
 	
 	bool loaded() const;
 	
+	LoadMode loadMode() const { return _load_mode; }
+	void setLoadMode(LoadMode mode) { _load_mode = mode; }
+	
 	void premultiply(ProEXRchannel *shared_alpha);
 	void unMult(ProEXRchannel *shared_alpha);
 	
@@ -178,7 +215,7 @@ class ProEXRlayer
 	void sortChannels();
 	void queryAbort();
 	
-	void setName(std::string name) { _name = name; }
+	void setName(std::string name);
 	
   private:
 	std::string _name;
@@ -187,6 +224,8 @@ class ProEXRlayer
 	ProEXRchannel *_alpha;
 	
 	ProEXRdoc *_doc;
+	
+	LoadMode _load_mode;
 };
 
 class ProEXRlayer_read : public ProEXRlayer
@@ -206,6 +245,44 @@ class ProEXRlayer_read : public ProEXRlayer
 	bool _load_as_layer;
 };
 
+// Name lookups for a document's channels() or layers().  Entries are added
+// as the vector grows at the end, and everything gets re-indexed when the
+// document says a name might have changed (see ProEXRdoc::namesChanged()).
+// The first item with a name wins, same as a linear search would have.
+template <class T>
+class ProEXRnameIndex
+{
+  public:
+	ProEXRnameIndex() : _size(0), _generation(-1) {}
+	~ProEXRnameIndex() {}
+	
+	T *find(const std::vector<T *> &items, const std::string &name, int generation) const;
+	
+  private:
+	void update(const std::vector<T *> &items, int generation, bool rebuild) const;
+	
+	typedef std::map<std::string, T *> IndexMap;
+	
+	mutable IndexMap _map;
+	mutable size_t _size;
+	mutable int _generation;
+};
+
+// what planMemory() decided, before anything got allocated
+typedef struct ProEXRlayerPlan {
+	ProEXRlayer *layer;
+	LoadMode mode;
+	Imath::Int64 bytes; // what the layer will hold on to
+} ProEXRlayerPlan;
+
+typedef struct ProEXRmemoryPlan {
+	std::vector<ProEXRlayerPlan> layers;
+	Imath::Int64 budget;	// 0 for no limit
+	Imath::Int64 resident;	// all the layers kept in memory
+	Imath::Int64 staging;	// reading the biggest streamed layer a block at a time
+	bool fits;				// false if it's over budget even after streaming all it can
+} ProEXRmemoryPlan;
+
 class ProEXRdoc 
 {
   public:
@@ -234,14 +311,35 @@ class ProEXRdoc
 	ProEXRlayer *findLayer(std::string layerName) const;
 	ProEXRlayer *findMainLayer(bool be_flexible=true, bool force=true) const;
 	
+	// call when a channel or layer name might have changed, or when channels() or
+	// layers() changed other than by adding to the end, so the lookups catch up
+	void namesChanged() { _names_generation++; }
+	
 	bool loaded() const;
 	Imath::Int64 memorySize() const; // the amount this would take up if it were fully loaded
 	void freeBuffers() const;
 	
+	ProEXRstats stats() const; // all the channels with valid stats together
+	
+	// keep HALF channels in 2-byte buffers instead of floats, set before anything is allocated
+	bool halfStorage() const { return _half_storage; }
+	void setHalfStorage(bool half_storage) { _half_storage = half_storage; }
+	
+	// How much the pixels may take up, 0 (the default) for no limit.  planMemory()
+	// works out how each layer fits under it without allocating anything, and
+	// applyMemoryPlan() sets the layers and channels up to load that way.
+	Imath::Int64 memoryBudget() const { return _memory_budget; }
+	void setMemoryBudget(Imath::Int64 budget) { _memory_budget = budget; }
+	
+	ProEXRmemoryPlan planMemory(bool allow_half=true) const; // allow_half=false if the host needs floats
+	void applyMemoryPlan(const ProEXRmemoryPlan &plan);
+	
   protected:
 	void premultiply();
 	void unMult();
 	
+	virtual ProEXRchannel *sharedAlpha() const { return getAlphaChannel(); } // for layers without their own alpha
+	
 	template <class NewLayerType>
 	void seperateAlphas();
 
@@ -257,6 +355,14 @@ class ProEXRdoc
   
 	ProEXRchannel *_black_channel;
 	ProEXRchannel *_white_channel;
+	
+	bool _half_storage;
+	
+	Imath::Int64 _memory_budget;
+	
+	ProEXRnameIndex<ProEXRchannel> _channel_index;
+	ProEXRnameIndex<ProEXRlayer> _layer_index;
+	int _names_generation;
 };
 
 class ProEXRdoc_read : public ProEXRdoc
@@ -279,7 +385,13 @@ class ProEXRdoc_read : public ProEXRdoc
 	
 	bool getClipAlpha() const { return _clipAlpha; }
 	
-	void loadFromFile();
+	void loadFromFile(bool unmult=false); // unmult while loading instead of calling unMult() after
+	
+	// only load this part of the data window, width() and height() will be its size
+	void setReadWindow(const Imath::Box2i &readWindow);
+	
+	// load at 1/scale size, from mip/rip levels when the file has them
+	void setProxyScale(int scale);
 	
 	virtual void queryAbort() {}
 	
@@ -364,6 +476,78 @@ void writeRGBAfile(Imf::OStream &os, Imf::Header &header, Imf::RgbaChannels mode
 					ProEXRchannel *r_chan, ProEXRchannel *g_chan, ProEXRchannel *b_chan, ProEXRchannel *a_chan);
 
 
+// Writes a scanline file one block of scanlines at a time, as producers
+// fill the blocks in.  Every channel gets its own buffer for each block
+// (just the block's rows), and once all of a block's channels are ready
+// it's compressed and written on a writer thread while the producers move on.
+//
+// Only maxBlocks() blocks are in memory at once, so asking for a block
+// further ahead waits until the blocks before it have gone out.  Blocks
+// are written in the file's line order (see orderedBlock()), which is the
+// order producers should work through them in.
+class ProEXRstreamWriter
+{
+  public:
+	// header has the channels already, block_lines and max_blocks of 0 pick
+	// something sensible, float_buffers makes HALF channels take floats
+	ProEXRstreamWriter(Imf::OStream &os, const Imf::Header &header,
+						int block_lines=0, int max_blocks=0, bool float_buffers=false);
+	virtual ~ProEXRstreamWriter(); // whatever hasn't been written yet is dropped
+	
+	const Imf::Header & header() const;
+	
+	int blocks() const { return _blocks; }
+	int blockLines() const { return _block_lines; }
+	int maxBlocks() const { return _max_blocks; }
+	
+	Imath::Box2i blockWindow(int block) const;
+	int orderedBlock(int n) const; // the n'th block to be written
+	
+	// The channel's buffer for a block, allocated the first time anyone asks.
+	// It's not cleared, so every pixel has to be filled in.
+	ProEXRbuffer channelBuffer(int block, const std::string &name);
+	void channelReady(int block, const std::string &name);
+	
+	// waits for the last block to be written, throwing whatever the writer ran into
+	void finish();
+	
+  private:
+	class StreamBlock;
+	class WriterThread;
+	
+	void writerLoop();
+	void writeReadyBlocks();
+	void fail(const std::string &error);
+	void wakeWaiters();
+
+	Imf::OutputFile *_file;
+	
+	Imath::Box2i _dw;
+	bool _decreasing;
+	
+	std::vector<std::string> _names;
+	std::vector<Imf::PixelType> _types;
+	std::map<std::string, int> _channel_index;
+	
+	int _block_lines;
+	int _blocks;
+	int _max_blocks;
+	
+	IlmThread::Mutex _mutex;
+	std::map<int, StreamBlock *> _live;
+	int _written; // blocks out the door, in line order
+	bool _finishing;
+	bool _failed;
+	std::string _error;
+	
+	IlmThread::Semaphore _work; // for the writer thread
+	IlmThread::Semaphore _room; // for producers waiting on a block
+	int _room_waiters;
+	
+	WriterThread *_thread; // NULL when writing happens in channelReady()
+};
+
+
 #ifndef MAX
 	#define MAX(A,B)	((A) > (B) ? (A) : (B))
 #endif
@@ -398,9 +582,9 @@ ProEXRchannel::getUintRGBchannels()
 	green->assignDoc(_doc);
 	blue->assignDoc(_doc);
 	
-	red->allocateBuffers(false);
-	green->allocateBuffers(false);
-	blue->allocateBuffers(false);
+	red->allocateBuffers(false, false);
+	green->allocateBuffers(false, false);
+	blue->allocateBuffers(false, false);
 
 	ProEXRbuffer red_buf = red->getBufferDesc(false);
 	ProEXRbuffer green_buf = green->getBufferDesc(false);
@@ -476,103 +660,134 @@ ProEXRdoc::getWhiteChannel()
 	return (ChannelType *)_white_channel;
 }
 
+template <class T>
+void
+ProEXRnameIndex<T>::update(const std::vector<T *> &items, int generation, bool rebuild) const
+{
+	if(rebuild || generation != _generation || items.size() < _size)
+	{
+		_map.clear();
+		_size = 0;
+		_generation = generation;
+	}
+	
+	// insert() leaves the first one with a name alone
+	for(; _size < items.size(); _size++)
+		_map.insert( std::make_pair(items[_size]->name(), items[_size]) );
+}
+
+template <class T>
+T *
+ProEXRnameIndex<T>::find(const std::vector<T *> &items, const std::string &name, int generation) const
+{
+	update(items, generation, false);
+	
+	typename IndexMap::const_iterator i = _map.find(name);
+	
+	if(i != _map.end() && i->second->name() != name)
+	{
+		// somebody renamed something without telling us
+		update(items, generation, true);
+		
+		i = _map.find(name);
+	}
+	
+	return (i != _map.end() ? i->second : NULL);
+}
+
 template <class NewLayerType>
 void
 ProEXRdoc::seperateAlphas()
 {
-	bool start_over = true;
+	// one pass, with each alpha's new layer going in front of the layer it came from
+	std::vector<ProEXRlayer *> new_layers;
 	
-	// keep running until we don't find any alphas to split
-	while(start_over)
+	for(std::vector<ProEXRlayer *>::iterator i = layers().begin(); i != layers().end(); ++i)
 	{
-		start_over = false;
+		ProEXRlayer *layer = *i;
 		
-		for(std::vector<ProEXRlayer *>::iterator i = layers().begin(); !start_over && i != layers().end(); ++i)
-		{
-			ProEXRlayer *layer = *i;
+		std::vector<ProEXRchannel *> &chans = layer->channels();
 		
-			if( layer->channels().size() > 1 )
+		for(int j=0; j < chans.size() && chans.size() > 1; )
+		{
+			ProEXRchannel *chan = chans[j];
+			
+			if(chan->channelTag() == CHAN_A)
 			{
-				for(std::vector<ProEXRchannel *>::iterator j = layer->channels().begin(); !start_over && j != layer->channels().end(); ++j)
-				{
-					ProEXRchannel *chan = *j;
-					
-					std::string ch_name = chan->name();
-					
-					if(chan->channelTag() == CHAN_A)
-					{
-						// remove the alpha from this layer
-						layer->channels().erase(j);
-						
-						// but remember the alpha in case we have to UnMult
-						layer->assignAlpha(chan);
-						
-						// make a new layer with the alpha, and insert it
-						NewLayerType *new_layer = new NewLayerType;
-						
-						new_layer->assignDoc(this);
-						
-						new_layer->addChannel(chan);
-						
-						layers().insert(i, new_layer);
-						
-						start_over = true;
-						break;
-					}
-				}
+				// remove the alpha from this layer
+				chans.erase(chans.begin() + j);
+				
+				// but remember the alpha in case we have to UnMult
+				layer->assignAlpha(chan);
+				
+				// make a new layer with the alpha
+				NewLayerType *new_layer = new NewLayerType;
+				
+				new_layer->assignDoc(this);
+				
+				new_layer->addChannel(chan);
+				
+				new_layers.push_back(new_layer);
 			}
-			
-			if(start_over)
-				break;
+			else
+				j++;
 		}
+		
+		new_layers.push_back(layer);
 	}
+	
+	layers().swap(new_layers);
+	
+	namesChanged();
 }
 
 template <class NewLayerType>
 void
 ProEXRdoc::overflowChannels()
 {
-	bool start_over = true;
+	// one pass, with each overflowed channel's new layer going in front of the layer it came from
+	std::vector<ProEXRlayer *> new_layers;
 	
-	// keep running until we don't find any layers to overflow
-	while(start_over)
+	for(std::vector<ProEXRlayer *>::iterator i = layers().begin(); i != layers().end(); ++i)
 	{
-		start_over = false;
+		ProEXRlayer *layer = *i;
 		
-		for(std::vector<ProEXRlayer *>::iterator i = layers().begin(); !start_over && i != layers().end(); ++i)
-		{
-			ProEXRlayer *layer = *i;
+		int non_alpha_channels = layer->getNonAlphaChannels().size();
 		
-			if( layer->getNonAlphaChannels().size() > 3 )
+		if(non_alpha_channels > 3)
+		{
+			std::vector<ProEXRchannel *> kept_channels;
+			
+			for(std::vector<ProEXRchannel *>::iterator j = layer->channels().begin(); j != layer->channels().end(); ++j)
 			{
-				for(std::vector<ProEXRchannel *>::iterator j = layer->channels().begin(); !start_over && j != layer->channels().end(); ++j)
+				ProEXRchannel *chan = *j;
+				
+				if(non_alpha_channels > 3 && chan->channelTag() == CHAN_GENERAL)
 				{
-					ProEXRchannel *chan = *j;
+					// make a new layer with the channel
+					NewLayerType *new_layer = new NewLayerType;
+					
+					new_layer->assignDoc(this);
+					
+					new_layer->addChannel(chan);
+					
+					new_layers.push_back(new_layer);
 					
-					if(chan->channelTag() == CHAN_GENERAL)
-					{
-						// remove the channel from this layer
-						layer->channels().erase(j);
-												
-						// make a new layer with the channel, and insert it
-						NewLayerType *new_layer = new NewLayerType;
-						
-						new_layer->assignDoc(this);
-						
-						new_layer->addChannel(chan);
-						
-						layers().insert(i, new_layer);
-						
-						start_over = true;
-						break;
-					}
+					non_alpha_channels--;
 				}
+				else
+					kept_channels.push_back(chan);
 			}
 			
-			if(start_over)
-				break;
+			layer->channels().swap(kept_channels);
 		}
+		
+		new_layers.push_back(layer);
 	}
+	
+	layers().swap(new_layers);
+	
+	namesChanged();
 }
 
 template <class ChannelType>
@@ -624,6 +839,9 @@ ProEXRdoc_read::buildLayers(bool split_alpha)
 	bool have_AG = false;
 	bool have_AB = false;
 	
+	// the layers made here by name, findLayer() would have to re-index after every channel
+	std::map<std::string, ProEXRlayer *> named_layers;
+	
 	// make the regular layers
 	for(std::vector<ProEXRchannel *>::iterator i = channels().begin(); i != channels().end(); ++i)
 	{
@@ -645,11 +863,11 @@ ProEXRdoc_read::buildLayers(bool split_alpha)
 		}
 		else
 		{
-			ProEXRlayer *layer = findLayer( chan->layerName() );
+			std::map<std::string, ProEXRlayer *>::const_iterator layer = named_layers.find( chan->layerName() );
 			
-			if(layer && chan->pixelType() != Imf::UINT)
+			if(layer != named_layers.end() && chan->pixelType() != Imf::UINT)
 			{
-				layer->addChannel( chan );
+				layer->second->addChannel( chan );
 			}
 			else
 			{
@@ -665,6 +883,8 @@ ProEXRdoc_read::buildLayers(bool split_alpha)
 				l->assignDoc(this);
 				
 				layers().push_back(l);
+				
+				named_layers.insert( std::make_pair(l->name(), l) );
 			}
 		}
 	}
@@ -36,6 +36,7 @@
 #include <ImfDeepFrameBuffer.h>
 
 #include "ProEXR_UTF.h"
+#include "ProEXR_PixelKernels.h"
 
 #include "PITerminology.h"
 
@@ -718,30 +719,13 @@ ProEXRchannel_readPS::copyToPhotoshop(int16 channel, ProEXRchannel *alpha, int n
 				// kill NaN
 				if(float_row)
 				{
-					float *float_pix = (float *)float_row;
-					
-					for(int x=0; x < width * (1 + end_scanline - y); x++)
-					{
-						KillNaN(*float_pix);
-						
-						float_pix++;
-					}
+					KillNaNRow((float *)float_row, width * (1 + end_scanline - y));
 				}
 				
 				// UnMult
 				if(alpha)
 				{
-					float *float_pix = (float *)float_row;
-					float *alpha_pix = (float *)alpha_row;
-					
-					for(int x=0; x < width * (1 + end_scanline - y); x++)
-					{
-						if(*alpha_pix > 0.0f && *alpha_pix < 1.0f && *float_pix != 0.0f)
-							*float_pix /= *alpha_pix;
-						
-						float_pix++;
-						alpha_pix++;
-					}
+					UnMultiplyRow((float *)float_row, (float *)alpha_row, width * (1 + end_scanline - y));
 				}
 				
 				// clip alpha
@@ -749,17 +733,7 @@ ProEXRchannel_readPS::copyToPhotoshop(int16 channel, ProEXRchannel *alpha, int n
 				{
 					assert(alpha == NULL);
 					
-					float *float_pix = (float *)float_row;
-					
-					for(int x=0; x < width * (1 + end_scanline - y); x++)
-					{
-						if(*float_pix < 0.f)
-							*float_pix = 0.f;
-						else if(*float_pix > 1.f)
-							*float_pix = 1.f;
-						
-						float_pix++;
-					}
+					AlphaClipRow((float *)float_row, width * (1 + end_scanline - y));
 				}
 				
 				// hand off to Photoshop
@@ -1005,11 +979,7 @@ ProEXRchannel_writePS::getLoadedLineBufferDesc(int start_scanline, int end_scanl
 	if(use_half)
 	{
 		// copy float to half
-		float *channel_pix = (float *)_data;
-		half *half_pix = (half *)_half_data;
-		
-		for(int x=0; x < _width * _height; x++)
-			*half_pix++ = *channel_pix++;
+		FloatToHalfRow((float *)_data, (half *)_half_data, _width * _height);
 			
 		size_t half_colbytes = sizeof(half);
 		
@@ -1295,32 +1265,29 @@ ProEXRlayer_readPS::copyToPhotoshop(int required_rgb_channels, int required_alph
 				{
 					float *float_pix = (float *)float_row;
 					
+					// Rgba is four halfs, same order as our float pixels
+					HalfToFloatRow(&half_buffer[local_y - y][0].r, float_pix, readPS_doc.width() * 4);
+					
 					for(int x=0; x < readPS_doc.width(); x++)
 					{
-						Rgba &rgba_pix = half_buffer[local_y - y][x];
+						float &alpha = float_pix[3];
 						
 						if(readPS_doc.getClipAlpha())
 						{
-							if(rgba_pix.a < 0.f)
-								rgba_pix.a = 0.f;
-							else if(rgba_pix.a > 1.f)
-								rgba_pix.a = 1.f;
+							if(alpha < 0.f)
+								alpha = 0.f;
+							else if(alpha > 1.f)
+								alpha = 1.f;
 						}
 						
-						if(unMult && have_a && rgba_pix.a > 0.0f && rgba_pix.a < 1.0f)
+						if(unMult && have_a && alpha > 0.0f && alpha < 1.0f)
 						{
-							*float_pix++ = (float)rgba_pix.r / (float)rgba_pix.a;
-							*float_pix++ = (float)rgba_pix.g / (float)rgba_pix.a;
-							*float_pix++ = (float)rgba_pix.b / (float)rgba_pix.a;
-							*float_pix++ = rgba_pix.a;
-						}
-						else
-						{
-							*float_pix++ = rgba_pix.r;
-							*float_pix++ = rgba_pix.g;
-							*float_pix++ = rgba_pix.b;
-							*float_pix++ = rgba_pix.a;
+							float_pix[0] /= alpha;
+							float_pix[1] /= alpha;
+							float_pix[2] /= alpha;
 						}
+						
+						float_pix += 4;
 					}
 					
 					float_row += float_rowbytes;
@@ -2024,13 +1991,17 @@ ProEXRdoc_readPS::ps_res() const
 void
 ProEXRdoc_readPS::loadFromFile(bool force)
 {
-	if(SafeAvailableMemory(true) > (memorySize() * 2) || force)
-	{
-		ProEXRdoc_read::loadFromFile();
-		
-		if(_unMult)
-			unMult(); // won't do anything if the file failed to load
-	}
+	// the document gets half of what's free (or everything, if forced), layers
+	// that don't fit get streamed straight to Photoshop, which only takes floats
+	setMemoryBudget(force ? 0 : SafeAvailableMemory(true) / 2);
+	
+	applyMemoryPlan( planMemory(false) );
+	
+	ProEXRdoc_read::loadFromFile(_unMult);
+	
+	// picks up Y[RY][BY] layers, channels already unmultiplied above are skipped
+	if(_unMult)
+		unMult(); // won't do anything to layers that aren't loaded
 }
 
 void
@@ -2198,19 +2169,11 @@ ProEXRdoc_readPS::setupDoc(bool split_alpha, bool use_layers_string)
 		buildLayers<ProEXRlayer_readPS>(split_alpha);
 }
 
-void
-ProEXRdoc_readPS::unMult()
+ProEXRchannel *
+ProEXRdoc_readPS::sharedAlpha() const
 {
-	if(_used_layers_string)
-	{
-		// don't want to unMult with a shared alpha in this case
-		for(vector<ProEXRlayer *>::iterator i = layers().begin(); i != layers().end(); ++i)
-			(*i)->unMult(NULL);
-	}
-	else
-	{
-		ProEXRdoc::unMult();
-	}
+	// don't want to unMult with a shared alpha in this case
+	return (_used_layers_string ? NULL : ProEXRdoc::sharedAlpha());
 }
 
 void
@@ -2590,6 +2553,8 @@ ProEXRdoc_writePS_RGBA::writeFile()
 		// our buffer to fill
 		Array2D<Rgba> half_buffer(cheapNumWriteRows, width);
 		
+		Array2D<half> half_rows(4, buf_width);
+		
 		
 		RgbaOutputFile file(stream(), header(), mode());
 		
@@ -2619,10 +2584,17 @@ ProEXRdoc_writePS_RGBA::writeFile()
 			
 			for(int local_y=y; local_y <= end_scanline; local_y++)
 			{
-				float *r_pix = (float *)r_row;
-				float *g_pix = (float *)g_row;
-				float *b_pix = (float *)b_row;
-				float *a_pix = (float *)a_row;
+				FloatToHalfRow((float *)r_row, half_rows[0], buf_width);
+				FloatToHalfRow((float *)g_row, half_rows[1], buf_width);
+				FloatToHalfRow((float *)b_row, half_rows[2], buf_width);
+				
+				if(a_chan)
+					FloatToHalfRow((float *)a_row, half_rows[3], buf_width);
+				
+				const half *r_pix = half_rows[0];
+				const half *g_pix = half_rows[1];
+				const half *b_pix = half_rows[2];
+				const half *a_pix = half_rows[3];
 				
 				for(int x=0; x < buf_width; x++)
 				{
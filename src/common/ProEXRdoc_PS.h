@@ -234,8 +234,10 @@ class ProEXRdoc_readPS : public ProEXRdoc_read
   private:	
 	void setupDoc(bool split_alpha, bool use_layers_string);
 	
-	void unMult();	// doing a weird thing here where this is declared public in the superclass but private here
-					// want to encourage/force putting the unMult paramater in the constuctor
+	void unMult() { ProEXRdoc::unMult(); }	// doing a weird thing here where this is declared public in the superclass but private here
+											// want to encourage/force putting the unMult paramater in the constuctor
+	
+	virtual ProEXRchannel *sharedAlpha() const;
 					
 	void calculateSafeLines();
 
@@ -27,6 +27,8 @@
 
 #include "zlib.h"
 
+#include <sstream>
+
 
 #define USE_ILMTHREAD 1
 
@@ -57,6 +57,7 @@
 #include "ProEXR_About.h"
 
 #include "ProEXR_UTF.h"
+#include "ProEXR_WriteBehindOStream.h"
 
 #include <ImfVersion.h>
 #include <ImfStandardAttributes.h>
@@ -521,14 +522,14 @@ static void DoReadStart(GPtr globals)
 	gStuff->imageHRes = exr->ps_res().x;
 	gStuff->imageVRes = exr->ps_res().y;
 	
-	// XMP description
-	CreateXMPdescription(globals, *exr);
-	
 	// got chromaticities?
 	GetEXRcolor(globals, exr->header());
 	
 	// load everything (will not actually load if insuffiecient memory)
 	exr->loadFromFile();
+	
+	// XMP description, after loading so it has the channel stats
+	CreateXMPdescription(globals, *exr);
 
 	gStuff->layerData = exr->layers().size();
 	
@@ -813,7 +814,9 @@ static void DoWriteContinue(GPtr globals)
 	
 	
 	// now make the file
-	OStreamPS ps_out(gStuff->dataFork, "Photoshop Output");
+	OStreamPS ps_data_fork(gStuff->dataFork, "Photoshop Output");
+	
+	WriteBehindOStream ps_out(ps_data_fork); // big writes on another thread while we compress
 	
 	PS_callbacks ps_calls = { globals->result, gStuff->channelPortProcs,
 							gStuff->abortProc, gStuff->progressProc, gStuff->handleProcs, gStuff->advanceState,
@@ -850,6 +853,8 @@ static void DoWriteContinue(GPtr globals)
 		output_file.writeFile();
 	}
 	
+	ps_out.flush(); // write errors come out here
+	
 	}
 	catch(AbortExc)
 	{
@@ -1057,7 +1062,9 @@ static void DoWriteLayerContinue(GPtr globals)
 		
 		
 		// now make the file
-		OStreamPS ps_out(gStuff->dataFork, "Photoshop Output");
+		OStreamPS ps_data_fork(gStuff->dataFork, "Photoshop Output");
+		
+		WriteBehindOStream ps_out(ps_data_fork); // big writes on another thread while we compress
 		
 		PS_callbacks ps_calls = { globals->result, gStuff->channelPortProcs,
 								gStuff->abortProc, gStuff->progressProc, gStuff->handleProcs, gStuff->advanceState,
@@ -1078,6 +1085,8 @@ static void DoWriteLayerContinue(GPtr globals)
 		output_file.loadFromPhotoshop(); // won't load if insufficient memory
 		
 		output_file.writeFile();
+		
+		ps_out.flush(); // write errors come out here
 			
 		}
 		catch(AbortExc)
@@ -523,11 +523,28 @@ static void AddDescription(string &desc, const ProEXRdoc_read &file)
 			desc += channel_name;
 			
 			if(pix_type == Imf::HALF)
-				desc += " (half)" + newline;
+				desc += " (half)";
 			else if(pix_type == Imf::FLOAT)
-				desc += " (float)" + newline;
+				desc += " (float)";
 			else if(pix_type == Imf::UINT)
-				desc += " (uint)" + newline;
+				desc += " (uint)";
+			
+			// what the pixels looked like, if they've been loaded
+			const ProEXRchannel *chan = file.findChannel( i.name() );
+			
+			if(chan && chan->stats().valid)
+			{
+				const ProEXRstats &stats = chan->stats();
+				
+				stringstream s;
+				
+				s << " min: " << stats.min << " max: " << stats.max << " mean: " << stats.mean;
+				s << " NaN: " << stats.nans << " inf: " << stats.infs << " negative: " << stats.negatives;
+				
+				desc += s.str();
+			}
+			
+			desc += newline;
 		}
 	}
 }
@@ -25,6 +25,7 @@
 
 #include "ProEXR_Attributes.h"
 #include "ProEXR_Color.h"
+#include "ProEXR_WriteBehindOStream.h"
 //#include "ProEXR_About.h"
 
 #include <ImfVersion.h>
@@ -655,7 +656,9 @@ static void DoWriteContinue (GPtr globals)
 	
 	
 	// now make the file
-	OStreamPS ps_out(gStuff->dataFork, "Photoshop Output");
+	OStreamPS ps_data_fork(gStuff->dataFork, "Photoshop Output");
+	
+	WriteBehindOStream ps_out(ps_data_fork); // big writes on another thread while we compress
 	
 	PS_callbacks ps_calls = { globals->result, gStuff->channelPortProcs,
 							gStuff->abortProc, gStuff->progressProc, gStuff->handleProcs, gStuff->advanceState,
@@ -666,6 +669,8 @@ static void DoWriteContinue (GPtr globals)
 
 	output_file.writeFile();
 	
+	ps_out.flush(); // write errors come out here
+	
 	}
 	catch(AbortExc)
 	{
@@ -26,6 +26,7 @@
 #include "ProEXR_Attributes.h"
 #include "ProEXR_Color.h"
 #include "ProEXR_About.h"
+#include "ProEXR_WriteBehindOStream.h"
 
 #include <ImfVersion.h>
 #include <ImfStandardAttributes.h>
@@ -709,7 +710,9 @@ static void DoWriteContinue (GPtr globals)
 	
 	
 	// now make the file
-	OStreamPS ps_out(gStuff->dataFork, "Photoshop Output");
+	OStreamPS ps_data_fork(gStuff->dataFork, "Photoshop Output");
+	
+	WriteBehindOStream ps_out(ps_data_fork); // big writes on another thread while we compress
 	
 	PS_callbacks ps_calls = { globals->result, gStuff->channelPortProcs,
 							gStuff->abortProc, gStuff->progressProc, gStuff->handleProcs, gStuff->advanceState,
@@ -749,6 +752,8 @@ static void DoWriteContinue (GPtr globals)
 		output_file.writeFile();
 	}
 	
+	ps_out.flush(); // write errors come out here
+	
 	}
 	catch(AbortExc)
 	{